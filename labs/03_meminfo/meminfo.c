@@ -1,9 +1,164 @@
 // meminfo.c - Minimal /proc/meminfo summary (kB)
+// Usage: ./meminfo
+//        ./meminfo --watch [S] [--count N]   (levels + reclaim/fault rates from /proc/vmstat every S seconds)
+//        ./meminfo --watch 0.1 --count 100   (10 Hz)
+//        ./meminfo --watch 0.1 --budget 0.5 [--budget-io KB] [--idle] [--cpu N]
+//                                            (stay under 0.5% of one core by sampling less often)
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../common/kvfile.h"
+#include "../common/dsgov.h"
+
+// ---- watch ----
+// /proc/vmstat and /proc/meminfo are sampled by slot through kvfile.h. One
+// row needs both, so the governor (../common/dsgov.h) paces them as one
+// source.
+
+static void gov_note(const char *msg) {
+    puts(msg);
+    fflush(stdout);
+}
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig) { (void)sig; stop = 1; }
+
+static double mono_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_header(void) {
+    printf("%8s %8s %8s %8s %8s |", "t", "avail_MB", "free_MB", "cache_MB", "swapf_MB");
+    for (int i = 0; i < VM_N; i++) printf(" %8s", vm_defs[i].col);
+    printf(" %5s\n", "eff%");
+}
+
+static struct kvfile vm_file, mi_file;
+
+static int run_watch(double interval, int count) {
+    if (kv_open(&vm_file, "/proc/vmstat", vm_slot) != 0) { perror("/proc/vmstat"); return 1; }
+    if (kv_open(&mi_file, "/proc/meminfo", mi_slot) != 0) { perror("/proc/meminfo"); return 1; }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int64_t prev[VM_N], cur[VM_N], mi[MI_N];
+    if (kv_sample(&vm_file, prev, VM_N) < 0) return 1;
+
+    printf("== meminfo levels + /proc/vmstat rates per second (%.2fs interval) ==\n", interval);
+    printf("scan/steal _k = kswapd, _d = direct reclaim; eff%% = steal/scan\n\n");
+
+    long long period_ns = (long long)(interval * 1e9);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double start = mono_s(), last = start, cost = 0;
+    int rows = 0;
+    int gs_kv = gov_add("vmstat+meminfo");
+    gov_start(start);
+
+    // count is in rows, so a slowed sampler still prints count rows.
+    for (unsigned long tick = 1; !stop && (!count || rows < count); tick++) {
+        unsigned long skip = gov_skip(tick);
+        tick += skip;
+        long long ahead = period_ns * (long long)(skip + 1);
+        next.tv_nsec += ahead % 1000000000L;
+        next.tv_sec += ahead / 1000000000L;
+        while (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !stop) {}
+        if (stop) break;
+        gov_check(mono_s(), 1.0 / interval);
+        if (!gov_due(gs_kv, tick)) continue;
+
+        double t0 = mono_s();
+        gov_begin();
+        int vr = kv_sample(&vm_file, cur, VM_N);
+        int mr = kv_sample(&mi_file, mi, MI_N);
+        gov_end(gs_kv);
+        if (vr < 0 || mr < 0) break;
+        cost += mono_s() - t0;
+        if (vr > 0 || mr > 0) {
+            // Layout changed (module load, kernel update in a container...).
+            kv_close(&vm_file);
+            kv_close(&mi_file);
+            if (kv_open(&vm_file, "/proc/vmstat", vm_slot) != 0) break;
+            if (kv_open(&mi_file, "/proc/meminfo", mi_slot) != 0) break;
+            kv_sample(&vm_file, prev, VM_N);
+            last = t0;
+            continue;
+        }
+
+        double dt = t0 - last;
+        last = t0;
+        gov_begin();
+        if (rows++ % 20 == 0) print_header();
+
+        // A key this kernel lacks prints "-", not a level or rate of 0.
+        printf("%8.2f", t0 - start);
+        static const int mi_cols[] = { MI_AVAIL, MI_FREE, MI_CACHED, MI_SWAPFREE };
+        for (int i = 0; i < 4; i++) {
+            if (mi[mi_cols[i]] >= 0) printf(" %8.0f", mi[mi_cols[i]] / 1024.0);
+            else printf(" %8s", "-");
+        }
+        printf(" |");
+        for (int i = 0; i < VM_N; i++) {
+            if (cur[i] >= 0 && prev[i] >= 0) printf(" %8.0f", (cur[i] - prev[i]) / dt);
+            else printf(" %8s", "-");
+        }
+        int64_t scan = 0, steal = 0;
+        for (int i = VM_SCAN_K; i <= VM_SCAN_D; i++) if (cur[i] >= 0 && prev[i] >= 0) scan += cur[i] - prev[i];
+        for (int i = VM_STEAL_K; i <= VM_STEAL_D; i++) if (cur[i] >= 0 && prev[i] >= 0) steal += cur[i] - prev[i];
+        if (scan) printf(" %5.1f\n", 100.0 * steal / scan);
+        else printf(" %5s\n", "-");
+        fflush(stdout);
+        memcpy(prev, cur, sizeof(prev));
+        gov_end_tick();
+    }
+    gov_summary(1.0 / interval);
+
+    if (rows)
+        printf("\nsample cost: %.1f us avg (%d + %d lines, 2 preads)\n",
+               cost / rows * 1e6, vm_file.nlines, mi_file.nlines);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double watch = 0;
+    int count = 0, idle = 0, cpu = -1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--watch")) {
+            watch = 1.0;
+            if (i + 1 < argc && atof(argv[i + 1]) > 0) watch = atof(argv[++i]);
+            if (watch < 0.01) watch = 0.01;
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            count = atoi(argv[++i]);
+            if (count < 0) count = 0;
+        } else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            gov.budget = atof(argv[++i]) / 100;
+        } else if (!strcmp(argv[i], "--budget-io") && i + 1 < argc) {
+            gov.io_budget = atof(argv[++i]) * 1024;
+        } else if (!strcmp(argv[i], "--idle")) {
+            idle = 1;
+        } else if (!strcmp(argv[i], "--cpu") && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
+        }
+    }
+    if (watch > 0) {
+        gov_sched(idle, cpu);
+        return run_watch(watch, count);
+    }
 
-int main(void) {
     long long total=-1, free=-1, avail=-1, cached=-1, buffers=-1;
     FILE *fp = fopen("/proc/meminfo", "r");
     if (!fp) { perror("fopen"); return 1; }
@@ -1,8 +1,26 @@
 // mounts.c - Read mount table (/proc/*/mounts) and print key mount points.
+// Usage: ./mounts [--all] [--format text|csv|tsv|json]
+//        ./mounts --io [S] [--count N] [--all]   (per-device I/O from /proc/diskstats every S seconds)
+//        ./mounts --io 0.1 --count 50           (10 Hz)
+//        ./mounts --io 0.1 --budget 0.5 [--budget-io KB] [--idle] [--cpu N]
+//                                               (stay under 0.5% of one core by sampling less often)
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "../common/outbuf.h"
+#include "../common/dsgov.h"
 
 static int interesting_target(const char *t) {
     return (!strcmp(t, "/") ||
@@ -16,7 +34,399 @@ static int interesting_target(const char *t) {
             !strncmp(t, "/sdcard", 7));
 }
 
-int main(void) {
+// ---- table output ----
+
+static const struct col mnt_cols[] = {
+    { "source", 18, 1 }, { "target", 22, 1 }, { "fstype", 8, 1 }, { "options", 0, 0 },
+};
+
+// ---- disk I/O ----
+// /proc/diskstats stays open and is re-read with pread() into a static
+// buffer; devices live in a fixed table, so a sample allocates nothing.
+// Partition/dm/loop kind and dm names are resolved when a device is first
+// seen; a device missing from a sample is dropped. Mount points come from
+// mountinfo's maj:min field. mountinfo also stays open: the kernel flags it
+// POLLPRI when the mount table changes, and only then is it re-read.
+
+#define DEV_MAX 512
+#define MM_MAX  1024
+
+struct io_ctr {
+    uint64_t rd, rd_sec, rd_ms, wr, wr_sec, wr_ms, io_ms, queue_ms;
+};
+
+struct blkdev {
+    unsigned major, minor;
+    char name[48];          // "dm-5:userdata" when dm has a name
+    char mount[64];
+    const char *kind;       // disk, part, dm, loop, zram
+    unsigned gen;           // last sample that listed the device
+    int pos;                // its index among the devices of that sample
+    int have_prev;
+    struct io_ctr prev, cur;
+};
+
+static struct blkdev devs[DEV_MAX];
+static int ndevs;
+
+static struct { unsigned major, minor; char target[64]; } mm[MM_MAX];
+static int nmm;
+
+static void mm_add(unsigned major, unsigned minor, const char *target) {
+    // One device is often mounted (or bind-mounted) several times: keep the
+    // interesting target, else the shortest.
+    for (int i = 0; i < nmm; i++) {
+        if (mm[i].major != major || mm[i].minor != minor) continue;
+        int old_i = interesting_target(mm[i].target), new_i = interesting_target(target);
+        if (new_i > old_i || (new_i == old_i && strlen(target) < strlen(mm[i].target)))
+            snprintf(mm[i].target, sizeof(mm[i].target), "%s", target);
+        return;
+    }
+    if (nmm == MM_MAX) return;
+    mm[nmm].major = major;
+    mm[nmm].minor = minor;
+    snprintf(mm[nmm].target, sizeof(mm[nmm].target), "%s", target);
+    nmm++;
+}
+
+static FILE *mi_fp;         // /proc/self/mountinfo, kept open for POLLPRI
+
+// Reading through mi_fp is also what clears its pending change event.
+static void load_mount_map(void) {
+    char line[1024], target[256];
+    unsigned major, minor;
+
+    nmm = 0;
+    if (!mi_fp) mi_fp = fopen("/proc/self/mountinfo", "r");
+    if (mi_fp) {
+        rewind(mi_fp);
+        while (fgets(line, sizeof(line), mi_fp))
+            if (sscanf(line, "%*d %*d %u:%u %*s %255s", &major, &minor, target) == 3 && major)
+                mm_add(major, minor, target);
+        return;
+    }
+
+    // No mountinfo: stat() the /proc/mounts sources instead.
+    FILE *fp = fopen("/proc/mounts", "r");
+    if (!fp) return;
+    char src[256];
+    struct stat st;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "%255s %255s", src, target) == 2 && src[0] == '/' &&
+            stat(src, &st) == 0 && S_ISBLK(st.st_mode))
+            mm_add(major(st.st_rdev), minor(st.st_rdev), target);
+    fclose(fp);
+}
+
+static int read_small(const char *path, char *buf, size_t cap) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, cap - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = 0;
+    buf[strcspn(buf, "\n")] = 0;
+    return 0;
+}
+
+static void dev_mount(struct blkdev *d) {
+    d->mount[0] = 0;
+    for (int i = 0; i < nmm; i++)
+        if (mm[i].major == d->major && mm[i].minor == d->minor)
+            snprintf(d->mount, sizeof(d->mount), "%s", mm[i].target);
+}
+
+static struct blkdev *dev_add(unsigned major, unsigned minor, const char *name, size_t nlen) {
+    if (ndevs == DEV_MAX) return NULL;
+    struct blkdev *d = &devs[ndevs++];
+    memset(d, 0, sizeof(*d));
+    d->major = major;
+    d->minor = minor;
+    snprintf(d->name, sizeof(d->name), "%.*s", (int)nlen, name);
+
+    char path[128], label[32];
+    if (!strncmp(d->name, "dm-", 3)) {
+        d->kind = "dm";
+        snprintf(path, sizeof(path), "/sys/block/%s/dm/name", d->name);
+        if (read_small(path, label, sizeof(label)) == 0 && label[0]) {
+            size_t n = strlen(d->name);
+            snprintf(d->name + n, sizeof(d->name) - n, ":%s", label);
+        }
+    } else if (!strncmp(d->name, "loop", 4)) {
+        d->kind = "loop";
+    } else if (!strncmp(d->name, "zram", 4)) {
+        d->kind = "zram";
+    } else {
+        snprintf(path, sizeof(path), "/sys/class/block/%s/partition", d->name);
+        d->kind = access(path, F_OK) == 0 ? "part" : "disk";
+    }
+    dev_mount(d);
+    return d;
+}
+
+// Same maj:min and kernel name ("dm-5" of "dm-5:userdata"). A replugged
+// disk can get a freed maj:min under another name; that is a new device.
+static int dev_is(const struct blkdev *d, unsigned major, unsigned minor, const char *name, size_t nlen) {
+    return d->major == major && d->minor == minor && !strncmp(d->name, name, nlen) &&
+           (d->name[nlen] == 0 || d->name[nlen] == ':');
+}
+
+// diskstats lines keep their order between reads and devs[] is kept in
+// that order, so the i-th device line is checked against slot i first; a
+// scan only happens when devices come or go.
+static struct blkdev *dev_find(unsigned major, unsigned minor, const char *name, size_t nlen, int hint) {
+    if (hint < ndevs && dev_is(&devs[hint], major, minor, name, nlen)) return &devs[hint];
+    for (int i = 0; i < ndevs; i++)
+        if (dev_is(&devs[i], major, minor, name, nlen)) return &devs[i];
+    return NULL;
+}
+
+// Drops devices the last sample did not list (hot-unplug, loop detach).
+static void dev_prune(unsigned gen) {
+    int n = 0;
+    for (int i = 0; i < ndevs; i++)
+        if (devs[i].gen == gen) {
+            if (n != i) devs[n] = devs[i];
+            n++;
+        }
+    ndevs = n;
+}
+
+static const char *skip_sp(const char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+static const char *parse_u64(const char *p, uint64_t *v) {
+    uint64_t x = 0;
+    p = skip_sp(p);
+    while (*p >= '0' && *p <= '9') x = x * 10 + (uint64_t)(*p++ - '0');
+    *v = x;
+    return p;
+}
+
+static int cmp_pos(const void *a, const void *b) {
+    return ((const struct blkdev *)a)->pos - ((const struct blkdev *)b)->pos;
+}
+
+// Room for DEV_MAX lines of ~200 bytes (20 counters and a name).
+static char ds_buf[DEV_MAX * 256];
+
+// Reads until EOF; if the file outgrows ds_buf, the tail is cut at a line
+// boundary with a one-time warning.
+static int read_diskstats(int fd) {
+    size_t have = 0, cap = sizeof(ds_buf) - 1;
+    ssize_t n;
+    while (have < cap && (n = pread(fd, ds_buf + have, cap - have, (off_t)have)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        have += (size_t)n;
+    }
+    if (have == cap) {
+        static int warned;
+        char c;
+        if (pread(fd, &c, 1, (off_t)have) > 0) {
+            char *nl = memrchr(ds_buf, '\n', have);
+            have = nl ? (size_t)(nl + 1 - ds_buf) : 0;
+            if (!warned++) fprintf(stderr, "warning: /proc/diskstats exceeds %zu KB; later devices ignored\n", cap / 1024);
+        }
+    }
+    ds_buf[have] = 0;
+    return have ? 0 : -1;
+}
+
+static int sample_diskstats(int fd, unsigned gen) {
+    if (read_diskstats(fd) != 0) return -1;
+
+    const char *p = ds_buf;
+    int seen = 0, moved = 0;
+    while (*p) {
+        uint64_t major, minor, f[11];
+        p = parse_u64(p, &major);
+        p = parse_u64(p, &minor);
+        p = skip_sp(p);
+        const char *name = p;
+        while (*p && *p != ' ' && *p != '\n') p++;
+        size_t nlen = (size_t)(p - name);
+        // reads merged sectors ms  writes merged sectors ms  in_flight io_ms weighted_ms
+        for (int i = 0; i < 11; i++) p = parse_u64(p, &f[i]);
+        while (*p && *p != '\n') p++;      // discard/flush fields on newer kernels
+        if (*p) p++;
+        if (!nlen) continue;
+
+        struct blkdev *d = dev_find((unsigned)major, (unsigned)minor, name, nlen, seen);
+        if (!d && !(d = dev_add((unsigned)major, (unsigned)minor, name, nlen))) continue;
+        if (d != &devs[seen]) moved = 1;
+        d->pos = seen;
+        d->prev = d->cur;
+        d->have_prev = d->gen && d->gen == gen - 1;
+        d->gen = gen;
+        d->cur = (struct io_ctr){ f[0], f[2], f[3], f[4], f[6], f[7], f[9], f[10] };
+        seen++;
+    }
+    if (seen < ndevs) dev_prune(gen);
+    // A device added mid-list went to the end: restore diskstats order.
+    if (moved) qsort(devs, (size_t)ndevs, sizeof(devs[0]), cmp_pos);
+    return 0;
+}
+
+// Non-blocking check for a mount table change; re-resolves every device.
+static void mounts_changed(void) {
+    if (!mi_fp) return;
+    struct pollfd pfd = { .fd = fileno(mi_fp), .events = POLLPRI };
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & (POLLPRI | POLLERR))) return;
+    load_mount_map();
+    for (int i = 0; i < ndevs; i++) dev_mount(&devs[i]);
+}
+
+static const struct col io_cols[] = {
+    { "device", 18, 1 }, { "kind", 4, 0 }, { "mount", 16, 1 },
+    { "r/s", 8, 0 }, { "w/s", 8, 0 }, { "rMB/s", 8, 0 }, { "wMB/s", 8, 0 },
+    { "r_ms", 7, 0 }, { "w_ms", 7, 0 }, { "qdepth", 6, 0 }, { "util%", 0, 0 },
+    { "t", -1, 0 },
+};
+
+static volatile sig_atomic_t io_stop = 0;
+
+static void io_on_signal(int sig) { (void)sig; io_stop = 1; }
+
+static double mono_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Rates over one interval. Latencies are per completed I/O; qdepth is the
+// weighted-ms counter over wall time (iostat's aqu-sz). The kernel counts in
+// ms, so at 10 Hz a single sample's latency is coarse by design.
+static void print_io(double t, double dt, int all) {
+    char title[96];
+    snprintf(title, sizeof(title), "\n== io (t=+%.1fs, %.3fs interval, /proc/diskstats) ==", t, dt);
+    out_note(title);
+    out_table(io_cols, (int)(sizeof(io_cols) / sizeof(io_cols[0])));
+
+    for (int i = 0; i < ndevs; i++) {
+        struct blkdev *d = &devs[i];
+        if (!d->have_prev) continue;
+        uint64_t rd = d->cur.rd - d->prev.rd, wr = d->cur.wr - d->prev.wr;
+        // Default view: mounted devices plus anything busy this interval.
+        if (!all && !(rd || wr) && !(d->mount[0] && interesting_target(d->mount))) continue;
+
+        out_str(d->name);
+        out_str(d->kind);
+        out_str(d->mount[0] ? d->mount : "-");
+        out_num(rd / dt, 1);
+        out_num(wr / dt, 1);
+        out_num((d->cur.rd_sec - d->prev.rd_sec) * 512.0 / dt / 1e6, 2);
+        out_num((d->cur.wr_sec - d->prev.wr_sec) * 512.0 / dt / 1e6, 2);
+        out_num(rd ? (double)(d->cur.rd_ms - d->prev.rd_ms) / rd : 0, 2);
+        out_num(wr ? (double)(d->cur.wr_ms - d->prev.wr_ms) / wr : 0, 2);
+        out_num((d->cur.queue_ms - d->prev.queue_ms) / (dt * 1000.0), 2);
+        double util = (d->cur.io_ms - d->prev.io_ms) / (dt * 10.0);
+        out_num(util > 100 ? 100 : util, 1);
+        out_num(t, 3);
+        out_end_row();
+    }
+    out_flush();
+}
+
+// Budget logic lives in ../common/dsgov.h; the governed source is the
+// diskstats sample. Notes go to stderr in the machine formats.
+static void gov_note(const char *msg) {
+    if (out.fmt != FMT_TEXT) { fprintf(stderr, "%s\n", msg); return; }
+    out_note(msg);
+    out_flush();
+}
+
+// count is in samples, so a slowed sampler still prints count tables.
+static int run_io(double interval, int count, int all) {
+    int fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "/proc/diskstats: %s\n", strerror(errno));
+        return 1;
+    }
+    load_mount_map();
+
+    signal(SIGINT, io_on_signal);
+    signal(SIGTERM, io_on_signal);
+
+    long long period_ns = (long long)(interval * 1e9);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double start = mono_s(), last = start;
+    unsigned gen = 1;
+    if (sample_diskstats(fd, gen) != 0) { perror("read /proc/diskstats"); return 1; }
+    int gs_io = gov_add("diskstats");
+    gov_start(start);
+
+    for (unsigned long tick = 1, r = 0; !io_stop && (!count || r < (unsigned long)count); tick++) {
+        unsigned long skip = gov_skip(tick);
+        tick += skip;
+        long long ahead = period_ns * (long long)(skip + 1);
+        next.tv_nsec += ahead % 1000000000L;
+        next.tv_sec += ahead / 1000000000L;
+        while (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !io_stop) {}
+        if (io_stop) break;
+
+        if (gov_due(gs_io, tick)) {
+            gov_begin();
+            mounts_changed();
+            int rc = sample_diskstats(fd, ++gen);
+            gov_end(gs_io);
+            if (rc != 0) break;
+
+            double now = mono_s();
+            gov_begin();
+            print_io(now - start, now - last, all);
+            gov_end_tick();
+            last = now;
+            r++;
+        }
+        gov_check(mono_s(), 1.0 / interval);
+    }
+    gov_summary(1.0 / interval);
+    out_flush();
+    close(fd);
+    if (mi_fp) fclose(mi_fp);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int all = 0, idle = 0, cpu = -1;
+    double io_interval = 0;
+    int io_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--all")) {
+            all = 1;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            out.fmt = parse_format(argv[++i]);
+            if (out.fmt < 0) { fprintf(stderr, "--format: text, csv, tsv or json\n"); return 1; }
+        } else if (!strcmp(argv[i], "--io")) {
+            io_interval = 1.0;
+            if (i + 1 < argc && atof(argv[i + 1]) > 0) io_interval = atof(argv[++i]);
+            if (io_interval < 0.01) io_interval = 0.01;
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            io_count = atoi(argv[++i]);
+            if (io_count < 0) io_count = 0;
+        } else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            gov.budget = atof(argv[++i]) / 100;
+        } else if (!strcmp(argv[i], "--budget-io") && i + 1 < argc) {
+            gov.io_budget = atof(argv[++i]) * 1024;
+        } else if (!strcmp(argv[i], "--idle")) {
+            idle = 1;
+        } else if (!strcmp(argv[i], "--cpu") && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
+        }
+    }
+
+    if (io_interval > 0) {
+        gov_sched(idle, cpu);
+        return run_io(io_interval, io_count, all);
+    }
+
     const char *paths[] = { "/proc/mounts", "/proc/self/mounts", "/proc/1/mounts" };
     FILE *fp = NULL;
     const char *used = NULL;
@@ -30,19 +440,26 @@ int main(void) {
         return 1;
     }
 
-    printf("== mounts (%s) ==\n", used);
-    printf("%-18s %-22s %-8s %s\n", "source", "target", "fstype", "options");
+    char title[64];
+    snprintf(title, sizeof(title), "== mounts (%s) ==", used);
+    out_note(title);
+    out_table(mnt_cols, 4);
 
     char src[256], tgt[256], fstype[64], opts[256];
     int dump1, dump2;
 
     while (fscanf(fp, "%255s %255s %63s %255s %d %d\n",
                   src, tgt, fstype, opts, &dump1, &dump2) == 6) {
-        if (!interesting_target(tgt)) continue;
-        printf("%-18.18s %-22.22s %-8.8s %s\n", src, tgt, fstype, opts);
+        if (!all && !interesting_target(tgt)) continue;
+        out_str(src);
+        out_str(tgt);
+        out_str(fstype);
+        out_str(opts);
+        out_end_row();
     }
 
     fclose(fp);
-    puts("\nTip: remove the interesting_target() filter to print *everything*.");
+    if (!all) out_note("\nTip: pass --all (or remove the interesting_target() filter) to print *everything*.");
+    out_flush();
     return 0;
 }
\ No newline at end of file
@@ -1,88 +1,582 @@
 // threads.c - List processes + thread count via /proc/[pid]/status (read-only)
 // Android note: some /proc entries may be Permission denied; we skip those.
+// Usage: ./threads [N | --all] [--uring] [--format text|csv|tsv|json] [--bench N]
+//        ./threads [N] --live [SECONDS]   (incremental table via the netlink proc connector)
+//        ./threads --live 1 --budget 0.5 [--budget-io KB] [--idle] [--cpu N]
+//                                         (cap at 0.5% of a core; the table refresh slows down to fit)
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#include "../common/rdbatch.h"
+#include "../common/outbuf.h"
+#include "../common/dsgov.h"
 
 static int is_number(const char *s) {
     for (; *s; s++) if (!isdigit((unsigned char)*s)) return 0;
     return 1;
 }
 
-static int read_status_fields(int pid, char *name, size_t name_sz,
-                              int *tgid, int *threads, char *state, size_t state_sz) {
-    char path[128];
-    snprintf(path, sizeof(path), "/proc/%d/status", pid);
-
-    FILE *fp = fopen(path, "r");
-    if (!fp) return -1;
-
-    char line[256];
+static void parse_status_fields(const char *buf, char *name, size_t name_sz,
+                                int *tgid, int *threads, char *state, size_t state_sz) {
     int got_name = 0, got_tgid = 0, got_threads = 0, got_state = 0;
 
-    while (fgets(line, sizeof(line), fp)) {
+    for (const char *line = buf; *line; ) {
         if (!got_name && sscanf(line, "Name:%63s", name) == 1) got_name = 1;
-        else if (!got_state && sscanf(line, "State:%15[^\n]", state) == 1) got_state = 1;
+        else if (!got_state && sscanf(line, "State: %15[^\n]", state) == 1) got_state = 1;
         else if (!got_tgid && sscanf(line, "Tgid:%d", tgid) == 1) got_tgid = 1;
         else if (!got_threads && sscanf(line, "Threads:%d", threads) == 1) got_threads = 1;
 
         if (got_name && got_state && got_tgid && got_threads) break;
+
+        const char *nl = strchr(line, '\n');
+        if (!nl) break;
+        line = nl + 1;
     }
-    fclose(fp);
 
     if (!got_name) snprintf(name, name_sz, "?");
     if (!got_state) snprintf(state, state_sz, "?");
     if (!got_tgid) *tgid = -1;
     if (!got_threads) *threads = -1;
+}
+
+// ---- table output ----
+
+static const struct col thr_cols[] = {
+    { "PID", 6, 0 }, { "TGID", 6, 0 }, { "THR", 7, 0 }, { "NAME", 18, 1 }, { "STATE", 0, 0 },
+};
+
+static void out_thread_row(int pid, int tgid, int thr, const char *name, const char *state) {
+    out_int(pid);
+    out_int(tgid);
+    out_int(thr);
+    out_str(name);
+    out_str(state);
+    out_end_row();
+}
+
+// /proc/[pid]/status is ~1.5 KB; Threads: sits well inside the first 4 KB.
+#define STATUS_CAP 4096
+#define BATCH      URING_FILES
+
+struct pid_list {
+    int *v;
+    int n;
+};
+
+static int list_pids(struct pid_list *pl) {
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+
+    int cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (!is_number(e->d_name)) continue;
+        if (pl->n == cap) {
+            cap = cap ? cap * 2 : 512;
+            int *nv = realloc(pl->v, (size_t)cap * sizeof(int));
+            if (!nv) break;
+            pl->v = nv;
+        }
+        pl->v[pl->n++] = atoi(e->d_name);
+    }
+    closedir(d);
+    return 0;
+}
+
+static char st_path[BATCH][32];
+static char st_buf[BATCH][STATUS_CAP];
+static struct rd st_req[BATCH];
+
+// Reads status for pids[0..n) (n <= BATCH) in one batch.
+static void read_status_batch(const int *pids, int n) {
+    for (int i = 0; i < n; i++) {
+        snprintf(st_path[i], sizeof(st_path[0]), "/proc/%d/status", pids[i]);
+        st_req[i].path = st_path[i];
+        st_req[i].buf = st_buf[i];
+        st_req[i].cap = STATUS_CAP;
+    }
+    read_batch(st_req, n);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_one(const struct pid_list *pl, int iters) {
+    g_syscalls = 0;
+    g_rd_path = 0;
+    double t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        for (int base = 0; base < pl->n; base += BATCH)
+            read_status_batch(pl->v + base, pl->n - base < BATCH ? pl->n - base : BATCH);
+    double dt = now_s() - t0;
+    printf("%-9s %6d %6d %10.1f %10.1f\n", rd_path_name(), iters, pl->n,
+           (double)g_syscalls / iters, dt * 1e6 / iters);
+}
+
+static int bench(int iters) {
+    struct pid_list pl = {0};
+    if (list_pids(&pl) != 0) { perror("opendir(/proc)"); return 1; }
+
+    puts("== bench: /proc/[pid]/status sweep ==");
+    printf("%-9s %6s %6s %10s %10s\n", "backend", "sweeps", "files", "syscalls", "us/sweep");
+
+    g_use_uring = 0;
+    bench_one(&pl, iters);
+
+    g_use_uring = 1;
+    if (uring_init() == 0) bench_one(&pl, iters);
+    else puts("io_uring  unavailable (kernel < 5.17, seccomp, or disabled)");
+
+    free(pl.v);
+    return 0;
+}
+
+// ---- overhead governor ----
+// Budget logic lives in ../common/dsgov.h; here the only governed
+// source is the table refresh. Notes go to stderr in the machine formats
+// so the rows stay parseable.
+
+static void gov_note(const char *msg) {
+    if (out.fmt != FMT_TEXT) { fprintf(stderr, "%s\n", msg); return; }
+    out_note(msg);
+    out_flush();
+}
+
+// ---- live mode ----
+// One full /proc scan, then the proc connector (fork/exec/exit/comm events)
+// marks table entries dirty and only those are re-read each interval. Needs
+// CAP_NET_ADMIN; without it, or after dropped events (ENOBUFS), we fall back
+// to / resync with a full scan.
+
+struct proc_ent {
+    int pid;                    // 0 = empty slot
+    int tgid, threads;
+    int dirty;
+    char name[64];
+    char state[32];
+};
+
+static struct proc_ent *pt;     // open addressing keyed by pid
+static int pt_cap, pt_used;
+
+static unsigned pid_hash(int pid) { return ((unsigned)pid * 2654435761u) & (unsigned)(pt_cap - 1); }
+
+static int pt_grow(void);
+
+static struct proc_ent *pt_get(int pid, int create) {
+    if (create && (pt_used + 1) * 2 > pt_cap && pt_grow() != 0) return NULL;
+    if (!pt_cap) return NULL;
+    for (unsigned i = pid_hash(pid); ; i = (i + 1) & (unsigned)(pt_cap - 1)) {
+        if (pt[i].pid == pid) return &pt[i];
+        if (!pt[i].pid) {
+            if (!create) return NULL;
+            memset(&pt[i], 0, sizeof(pt[i]));
+            pt[i].pid = pid;
+            pt[i].dirty = 1;
+            pt_used++;
+            return &pt[i];
+        }
+    }
+}
+
+static int pt_grow(void) {
+    int ncap = pt_cap ? pt_cap * 2 : 4096;
+    struct proc_ent *old = pt;
+    int ocap = pt_cap;
+    pt = calloc((size_t)ncap, sizeof(*pt));
+    if (!pt) { pt = old; return -1; }
+    pt_cap = ncap;
+    pt_used = 0;
+    for (int i = 0; i < ocap; i++) {
+        if (!old[i].pid) continue;
+        struct proc_ent *e = pt_get(old[i].pid, 1);
+        *e = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Backward-shift delete keeps probe chains intact without tombstones.
+static void pt_del(int pid) {
+    if (!pt_cap) return;
+    unsigned mask = (unsigned)(pt_cap - 1), i = pid_hash(pid);
+    while (pt[i].pid && pt[i].pid != pid) i = (i + 1) & mask;
+    if (!pt[i].pid) return;
+    pt[i].pid = 0;
+    pt_used--;
+    for (unsigned j = (i + 1) & mask; pt[j].pid; j = (j + 1) & mask) {
+        unsigned h = pid_hash(pt[j].pid);
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            pt[i] = pt[j];
+            pt[j].pid = 0;
+            i = j;
+        }
+    }
+}
+
+static struct {
+    unsigned long forks, execs, exits, rereads, resyncs;
+} lst;
+
+// Re-reads every dirty entry in batches; entries that vanished are dropped
+// after the walk, since a backward-shift delete can move a later entry into
+// a slot the walk has already passed.
+static void pt_refresh(void) {
+    static int *dead;
+    static int dead_cap;
+    int pids[BATCH], n = 0, ndead = 0;
+    for (int i = 0; i <= pt_cap; i++) {
+        if (i < pt_cap && pt[i].pid && pt[i].dirty) pids[n++] = pt[i].pid;
+        if (n == BATCH || (i == pt_cap && n)) {
+            read_status_batch(pids, n);
+            for (int k = 0; k < n; k++) {
+                if (st_req[k].res <= 0) {
+                    if (ndead == dead_cap) {
+                        int ncap = dead_cap ? dead_cap * 2 : 256;
+                        int *nd = realloc(dead, (size_t)ncap * sizeof(*dead));
+                        if (!nd) continue;      // stays dirty; retried next interval
+                        dead = nd;
+                        dead_cap = ncap;
+                    }
+                    dead[ndead++] = pids[k];
+                    continue;
+                }
+                struct proc_ent *e = pt_get(pids[k], 0);
+                if (!e) continue;
+                parse_status_fields(st_buf[k], e->name, sizeof(e->name), &e->tgid, &e->threads,
+                                    e->state, sizeof(e->state));
+                e->dirty = 0;
+                lst.rereads++;
+            }
+            n = 0;
+        }
+    }
+    for (int i = 0; i < ndead; i++) pt_del(dead[i]);
+}
+
+static void pt_full_scan(void) {
+    struct pid_list pl = {0};
+    if (list_pids(&pl) != 0) return;
+    for (int i = 0; i < pt_cap; i++) pt[i].pid = 0;
+    pt_used = 0;
+    for (int i = 0; i < pl.n; i++) pt_get(pl.v[i], 1);
+    free(pl.v);
+    pt_refresh();
+}
+
+static int cn_open(void) {
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_CONNECTOR);
+    if (fd < 0) return -1;
+
+    int rcv = 4 << 20;          // bursts of fork/exit can be large; fewer ENOBUFS
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
 
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC };
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) { close(fd); return -1; }
+
+    struct {
+        struct nlmsghdr nl;
+        struct cn_msg cn;
+        enum proc_cn_mcast_op op;
+    } __attribute__((packed, aligned(NLMSG_ALIGNTO))) msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.nl.nlmsg_len = sizeof(msg);
+    msg.nl.nlmsg_type = NLMSG_DONE;
+    msg.nl.nlmsg_pid = (unsigned)getpid();
+    msg.cn.id.idx = CN_IDX_PROC;
+    msg.cn.id.val = CN_VAL_PROC;
+    msg.cn.ack = (unsigned)getpid();    // the reply carries ack + 1: tells ours from other listeners
+    msg.cn.len = sizeof(enum proc_cn_mcast_op);
+    msg.op = PROC_CN_MCAST_LISTEN;
+    if (send(fd, &msg, sizeof(msg), 0) != (ssize_t)sizeof(msg)) { close(fd); return -1; }
+
+    // The kernel answers with PROC_EVENT_NONE carrying the subscribe result
+    // (EPERM without CAP_NET_ADMIN, or in a non-initial namespace). Events
+    // from before the initial scan are skipped; the scan covers them.
+    char buf[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+    double deadline = now_s() + 1.0;
+    for (;;) {
+        double left = deadline - now_s();
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (left <= 0 || poll(&pfd, 1, (int)(left * 1000) + 1) == 0) { errno = ETIMEDOUT; break; }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            break;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type == NLMSG_ERROR || h->nlmsg_type == NLMSG_NOOP) continue;
+            struct cn_msg *cn = NLMSG_DATA(h);
+            const struct proc_event *ev = (const struct proc_event *)cn->data;
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC || ev->what != PROC_EVENT_NONE ||
+                cn->ack != msg.cn.ack + 1)
+                continue;
+            if (ev->event_data.ack.err == 0) return fd;
+            errno = (int)ev->event_data.ack.err;
+            close(fd);
+            return -1;
+        }
+    }
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+static void cn_event(const struct proc_event *ev) {
+    struct proc_ent *e;
+    switch (ev->what) {
+    case PROC_EVENT_FORK: {
+        int pid = ev->event_data.fork.child_pid, tgid = ev->event_data.fork.child_tgid;
+        if (pid == tgid) {
+            lst.forks++;
+            pt_get(pid, 1);
+        } else if ((e = pt_get(tgid, 0)) != NULL) {
+            e->dirty = 1;       // new thread: Threads: changed
+        }
+        break;
+    }
+    case PROC_EVENT_EXEC:
+        lst.execs++;
+        if ((e = pt_get(ev->event_data.exec.process_tgid, 1)) != NULL) e->dirty = 1;
+        break;
+    case PROC_EVENT_COMM:
+        if ((e = pt_get(ev->event_data.comm.process_tgid, 0)) != NULL) e->dirty = 1;
+        break;
+    case PROC_EVENT_EXIT: {
+        int pid = ev->event_data.exit.process_pid, tgid = ev->event_data.exit.process_tgid;
+        if (pid == tgid) { lst.exits++; pt_del(pid); }
+        else if ((e = pt_get(tgid, 0)) != NULL) e->dirty = 1;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Drains the socket. Returns -1 if events were dropped (caller resyncs).
+static int cn_drain(int fd) {
+    char buf[16384] __attribute__((aligned(NLMSG_ALIGNTO)));
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return 0;
+            return errno == ENOBUFS ? -1 : 0;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type == NLMSG_ERROR || h->nlmsg_type == NLMSG_NOOP) continue;
+            struct cn_msg *cn = NLMSG_DATA(h);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+            cn_event((const struct proc_event *)cn->data);
+        }
+    }
+}
+
+static int cmp_pid(const void *a, const void *b) {
+    return ((const struct proc_ent *)a)->pid - ((const struct proc_ent *)b)->pid;
+}
+
+static void pt_print(int limit, const char *source) {
+    static struct proc_ent *view;
+    static int view_cap;
+    if (view_cap < pt_used) {
+        struct proc_ent *nv = realloc(view, (size_t)pt_cap * sizeof(*view));
+        if (!nv) return;
+        view = nv;
+        view_cap = pt_cap;
+    }
+    int n = 0;
+    for (int i = 0; i < pt_cap; i++) if (pt[i].pid) view[n++] = pt[i];
+    qsort(view, (size_t)n, sizeof(*view), cmp_pid);
+
+    char title[160];
+    snprintf(title, sizeof(title),
+             "== live threads (%s): %d procs | +%lu fork, %lu exec, %lu exit, %lu re-read, %lu resync ==",
+             source, n, lst.forks, lst.execs, lst.exits, lst.rereads, lst.resyncs);
+    out_note(title);
+    out_table(thr_cols, 5);
+    for (int i = 0; i < n && i != limit; i++)
+        out_thread_row(view[i].pid, view[i].tgid, view[i].threads, view[i].name, view[i].state);
+    out_note("");
+    out_flush();
+    memset(&lst, 0, sizeof(lst));
+}
+
+static volatile sig_atomic_t live_stop = 0;
+static void on_signal(int sig) { (void)sig; live_stop = 1; }
+
+static int run_live(int limit, int interval_s) {
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    // Subscribe before the initial scan so nothing falls in between.
+    int cn = cn_open();
+    if (cn < 0) {
+        // Said on stderr too in the machine formats, so a fallback is never silent.
+        char note[160];
+        snprintf(note, sizeof(note), "note: proc connector unavailable (%s; needs CAP_NET_ADMIN); "
+                 "falling back to full scans", strerror(errno));
+        if (out.fmt == FMT_TEXT) out_note(note);
+        else fprintf(stderr, "%s\n", note);
+        out_flush();
+    }
+    pt_full_scan();
+    memset(&lst, 0, sizeof(lst));
+
+    // Events keep draining at full rate either way (a backlog would only
+    // end in ENOBUFS and a resync); the governor spaces out the re-reads.
+    int gs_table = gov_add(cn >= 0 ? "refresh" : "full scan");
+    gov_start(now_s());
+
+    for (unsigned long tick = 0; !live_stop; tick++) {
+        double deadline = now_s() + interval_s;
+        int due = gov_due(gs_table, tick);
+        if (cn >= 0) {
+            struct pollfd pfd = { .fd = cn, .events = POLLIN };
+            double left;
+            while (!live_stop && (left = deadline - now_s()) > 0) {
+                if (poll(&pfd, 1, (int)(left * 1000) + 1) > 0 && cn_drain(cn) != 0) {
+                    lst.resyncs++;
+                    gov_begin();
+                    pt_full_scan();
+                    gov_end(gs_table);
+                }
+            }
+            if (due) {
+                gov_begin();
+                pt_refresh();
+                gov_end(gs_table);
+            }
+        } else {
+            struct timespec ts = { interval_s, 0 };
+            while (nanosleep(&ts, &ts) != 0 && !live_stop) {}
+            if (due) {
+                gov_begin();
+                pt_full_scan();
+                gov_end(gs_table);
+            }
+        }
+        if (due && !live_stop) {
+            gov_begin();
+            pt_print(limit, cn >= 0 ? "connector" : "full scan");
+            gov_end_tick();
+        }
+        gov_check(now_s(), 1.0 / interval_s);
+    }
+    gov_summary(1.0 / interval_s);
+
+    if (cn >= 0) close(cn);
+    free(pt);
     return 0;
 }
 
 int main(int argc, char **argv) {
     int limit = 30;
-    if (argc >= 2) {
-        limit = atoi(argv[1]);
-        if (limit <= 0) limit = 30;
-        if (limit > 200) limit = 200;
+    int live_s = 0;
+    int idle = 0, cpu = -1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--uring")) {
+            g_use_uring = 1;
+        } else if (!strcmp(argv[i], "--live")) {
+            live_s = 2;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) live_s = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            gov.budget = atof(argv[++i]) / 100;
+        } else if (!strcmp(argv[i], "--budget-io") && i + 1 < argc) {
+            gov.io_budget = atof(argv[++i]) * 1024;
+        } else if (!strcmp(argv[i], "--idle")) {
+            idle = 1;
+        } else if (!strcmp(argv[i], "--cpu") && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench")) {
+            int n = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+            return bench(n > 0 ? n : 20);
+        } else if (!strcmp(argv[i], "--all")) {
+            limit = -1;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            out.fmt = parse_format(argv[++i]);
+            if (out.fmt < 0) { fprintf(stderr, "--format: text, csv, tsv or json\n"); return 1; }
+        } else {
+            limit = atoi(argv[i]);
+            if (limit <= 0) limit = 30;
+            if (limit > 200) limit = 200;
+        }
     }
 
-    DIR *d = opendir("/proc");
-    if (!d) { perror("opendir(/proc)"); return 1; }
+    if (live_s) {
+        if (g_use_uring && uring_init() != 0) g_use_uring = 0;
+        gov_sched(idle, cpu);
+        return run_live(limit, live_s);
+    }
 
-    puts("== threads (/proc/[pid]/status) ==");
-    printf("showing up to %d readable entries\n\n", limit);
-    printf("%-6s %-6s %-7s %-18s %s\n", "PID", "TGID", "THR", "NAME", "STATE");
+    struct pid_list pl = {0};
+    if (list_pids(&pl) != 0) { perror("opendir(/proc)"); return 1; }
 
-    struct dirent *e;
-    int shown = 0;
+    out_note("== threads (/proc/[pid]/status) ==");
+    if (g_use_uring && uring_init() != 0) {
+        out_note("note: io_uring unavailable; using sync reads");
+        g_use_uring = 0;
+    }
+    if (out.fmt == FMT_TEXT) {
+        char l[64];
+        if (limit < 0) snprintf(l, sizeof(l), "showing all readable entries\n");
+        else snprintf(l, sizeof(l), "showing up to %d readable entries\n", limit);
+        out_note(l);
+    }
+    out_table(thr_cols, 5);
 
-    while ((e = readdir(d)) != NULL) {
-        if (!is_number(e->d_name)) continue;
-        int pid = atoi(e->d_name);
+    int shown = 0;
+    int want = limit < 0 ? pl.n : limit;
 
-        char name[64] = {0};
-        char state[32] = {0};
-        int tgid = -1, thr = -1;
+    for (int base = 0, n = 0; base < pl.n && shown < want; base += n) {
+        // Only fetch as many as could still be shown; denied ones roll into the next batch.
+        n = want - shown;
+        if (n > pl.n - base) n = pl.n - base;
+        if (n > BATCH) n = BATCH;
+        read_status_batch(pl.v + base, n);
 
-        if (read_status_fields(pid, name, sizeof(name), &tgid, &thr, state, sizeof(state)) != 0)
-            continue; // permission denied or disappeared
+        for (int i = 0; i < n && shown < want; i++) {
+            if (st_req[i].res <= 0) continue; // permission denied or disappeared
 
-        printf("%-6d %-6d %-7d %-18.18s %s\n", pid, tgid, thr, name, state);
+            char name[64] = {0};
+            char state[32] = {0};
+            int tgid = -1, thr = -1;
+            parse_status_fields(st_buf[i], name, sizeof(name), &tgid, &thr, state, sizeof(state));
 
-        if (++shown >= limit) break;
+            out_thread_row(pl.v[base + i], tgid, thr, name, state);
+            shown++;
+        }
     }
 
-    closedir(d);
+    free(pl.v);
 
     if (shown == 0) {
-        puts("no readable /proc/[pid]/status entries (blocked?)");
-        puts("hint: try: su -c ./threads 30");
+        out_note("no readable /proc/[pid]/status entries (blocked?)");
+        out_note("hint: try: su -c ./threads 30");
+        out_flush();
         return 1;
     }
 
-    puts("\nTip: Threads: shows how many kernel threads exist inside a process.");
+    out_note("\nTip: Threads: shows how many kernel threads exist inside a process.");
+    out_flush();
     return 0;
 }
\ No newline at end of file
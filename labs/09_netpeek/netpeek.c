@@ -1,9 +1,16 @@
-// netpeek.c - Read-only overview of /proc/net/tcp and /proc/net/udp
+// netpeek.c - Read-only overview of /proc/net/tcp{,6} and /proc/net/udp{,6}
 // If /proc is blocked, fall back to `su -c cat` (still read-only).
+// Usage: ./netpeek [N | --all] [--format text|csv|tsv|json]
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../common/outbuf.h"
 
 static const char* tcp_state(unsigned int st) {
     switch (st) {
@@ -22,13 +29,105 @@ static const char* tcp_state(unsigned int st) {
     }
 }
 
-static void ip_from_hex(unsigned int hex, char out[16]) {
-    // /proc/net/tcp uses little-endian hex for IPv4
-    unsigned int b1 = (hex) & 0xFF;
-    unsigned int b2 = (hex >> 8) & 0xFF;
-    unsigned int b3 = (hex >> 16) & 0xFF;
-    unsigned int b4 = (hex >> 24) & 0xFF;
-    snprintf(out, 16, "%u.%u.%u.%u", b1, b2, b3, b4);
+// ---- table output ----
+
+static const char hexd[] = "0123456789abcdef";
+
+// /proc/net/tcp uses little-endian hex for IPv4: low byte is the first octet.
+static char *fmt_ipv4(char *p, uint32_t hex) {
+    for (int i = 0; i < 4; i++) {
+        char tmp[4], *end = tmp + sizeof(tmp), *d = fmt_u64(end, (hex >> (8 * i)) & 0xFF);
+        while (d < end) *p++ = *d++;
+        if (i < 3) *p++ = '.';
+    }
+    return p;
+}
+
+// tcp6 prints the address as four 32-bit words, each little-endian like IPv4.
+// Output follows RFC 5952: lowercase, longest zero run as "::", and
+// ::ffff:a.b.c.d for v4-mapped addresses.
+static char *fmt_ipv6(char *p, const uint32_t w[4]) {
+    uint16_t g[8];
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = w[i];
+        g[2*i]   = (uint16_t)(((v & 0xFF) << 8) | ((v >> 8) & 0xFF));
+        g[2*i+1] = (uint16_t)((((v >> 16) & 0xFF) << 8) | ((v >> 24) & 0xFF));
+    }
+    if (!g[0] && !g[1] && !g[2] && !g[3] && !g[4] && g[5] == 0xFFFF) {
+        memcpy(p, "::ffff:", 7);
+        return fmt_ipv4(p + 7, w[3]);
+    }
+
+    int best = -1, best_len = 1;
+    for (int i = 0; i < 8; ) {
+        if (g[i]) { i++; continue; }
+        int j = i;
+        while (j < 8 && !g[j]) j++;
+        if (j - i > best_len) { best = i; best_len = j - i; }
+        i = j;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if (i == best) {
+            *p++ = ':';
+            if (i == 0) *p++ = ':';
+            i += best_len - 1;
+            continue;
+        }
+        int started = 0;
+        for (int sh = 12; sh >= 0; sh -= 4) {
+            int d = (g[i] >> sh) & 15;
+            if (d || started || sh == 0) { *p++ = hexd[d]; started = 1; }
+        }
+        if (i < 7) *p++ = ':';
+    }
+    return p;
+}
+
+static void out_endpoint(int v6, const uint32_t ip[4], unsigned port) {
+    char tmp[64], *p = tmp;
+    if (v6) { *p++ = '['; p = fmt_ipv6(p, ip); *p++ = ']'; }
+    else p = fmt_ipv4(p, ip[0]);
+    *p++ = ':';
+    char num[8], *end = num + sizeof(num), *d = fmt_u64(end, port);
+    while (d < end) *p++ = *d++;
+    out_cell(tmp, (size_t)(p - tmp), 0);
+}
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static const char *parse_hex32(const char *p, uint32_t *out_v) {
+    uint32_t v = 0;
+    int n = 0, d;
+    while (n < 8 && (d = hexval(*p)) >= 0) { v = (v << 4) | (uint32_t)d; p++; n++; }
+    *out_v = v;
+    return n ? p : NULL;
+}
+
+// "  12: 0100007F:0035 00000000:0000 0A ..." (tcp6: 32 hex digits per address)
+static int parse_line(const char *p, int v6, uint32_t lip[4], unsigned *lport,
+                      uint32_t rip[4], unsigned *rport, unsigned *st) {
+    while (*p == ' ') p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p++ != ':' || *p++ != ' ') return -1;
+
+    uint32_t v;
+    for (int side = 0; side < 2; side++) {
+        uint32_t *ip = side ? rip : lip;
+        for (int i = 0; i < (v6 ? 4 : 1); i++)
+            if (!(p = parse_hex32(p, &ip[i]))) return -1;
+        if (*p++ != ':' || !(p = parse_hex32(p, &v))) return -1;
+        *(side ? rport : lport) = v;
+        if (*p++ != ' ') return -1;
+    }
+    if (!parse_hex32(p, &v)) return -1;
+    *st = v;
+    return 0;
 }
 
 static FILE* open_source(const char *path) {
@@ -47,72 +146,84 @@ static void close_source(FILE *fp, int via_popen) {
     else fclose(fp);
 }
 
-static void dump_table(const char *label, const char *path, int limit) {
+static const struct col net_cols[] = {
+    { "proto", -1, 0 }, { "state", 12, 0 }, { "local", 22, 0 }, { "remote", 0, 0 },
+};
+
+// limit < 0 = everything
+static void dump_table(const char *label, const char *proto, const char *path, int limit) {
     FILE *fp = fopen(path, "r");
     int via_popen = 0;
     if (!fp) {
         fp = open_source(path);
         via_popen = 1;
     }
+
+    char line[512];
     if (!fp) {
-        printf("== %s ==\n", label);
-        printf("blocked: cannot read %s (try running with root)\n\n", path);
+        snprintf(line, sizeof(line), "== %s ==\nblocked: cannot read %s (try running with root)\n", label, path);
+        out_note(line);
         return;
     }
 
-    char line[512];
     // skip header
     if (!fgets(line, sizeof(line), fp)) { close_source(fp, via_popen); return; }
 
-    printf("== %s ==\n", label);
-    printf("%-12s %-22s %-22s\n", "state", "local", "remote");
+    int v6 = strchr(proto, '6') != NULL;
+    snprintf(line, sizeof(line), "== %s ==", label);
+    out_note(line);
+    out_table(net_cols, 4);
 
     int count = 0;
     while (fgets(line, sizeof(line), fp)) {
-        unsigned int lip=0, rip=0, lport=0, rport=0, st=0;
-
-        // Example fields: local_address rem_address st ...
-        // We'll parse only the parts we need:
-        // "%*d: %8X:%4X %8X:%4X %2X"
-        if (sscanf(line, " %*d: %8X:%4X %8X:%4X %2X",
-                   &lip, &lport, &rip, &rport, &st) != 5) {
-            continue;
-        }
-
-        char lip_s[16], rip_s[16];
-        ip_from_hex(lip, lip_s);
-        ip_from_hex(rip, rip_s);
+        uint32_t lip[4], rip[4];
+        unsigned lport = 0, rport = 0, st = 0;
+        if (parse_line(line, v6, lip, &lport, rip, &rport, &st) != 0) continue;
 
-        char local[32], remote[32];
-        snprintf(local, sizeof(local), "%s:%u", lip_s, lport);
-        snprintf(remote, sizeof(remote), "%s:%u", rip_s, rport);
+        out_str(proto);
+        out_str(tcp_state(st));
+        out_endpoint(v6, lip, lport);
+        out_endpoint(v6, rip, rport);
+        out_end_row();
 
-        printf("%-12s %-22s %-22s\n",
-               tcp_state(st), local, remote);
-
-        if (++count >= limit) break;
+        if (++count == limit) break;
     }
 
-    if (count == 0) puts("(no entries)\n");
-    else puts("");
+    if (count == 0) out_note("(no entries)\n");
+    else out_note("");
 
     close_source(fp, via_popen);
 }
 
 int main(int argc, char **argv) {
     int limit = 20;
-    if (argc >= 2) {
-        limit = atoi(argv[1]);
-        if (limit <= 0) limit = 20;
-        if (limit > 200) limit = 200;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--all")) {
+            limit = -1;
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            out.fmt = parse_format(argv[++i]);
+            if (out.fmt < 0) { fprintf(stderr, "--format: text, csv, tsv or json\n"); return 1; }
+        } else {
+            limit = atoi(argv[i]);
+            if (limit <= 0) limit = 20;
+            if (limit > 200) limit = 200;
+        }
     }
 
-    puts("== netpeek ==");
-    printf("showing up to %d entries per table\n\n", limit);
+    out_note("== netpeek ==");
+    if (out.fmt == FMT_TEXT) {
+        char l[64];
+        if (limit < 0) snprintf(l, sizeof(l), "showing all entries\n");
+        else snprintf(l, sizeof(l), "showing up to %d entries per table\n", limit);
+        out_note(l);
+    }
 
-    dump_table("TCP sockets (/proc/net/tcp)", "/proc/net/tcp", limit);
-    dump_table("UDP sockets (/proc/net/udp)", "/proc/net/udp", limit);
+    dump_table("TCP sockets (/proc/net/tcp)",  "tcp",  "/proc/net/tcp",  limit);
+    dump_table("TCP6 sockets (/proc/net/tcp6)", "tcp6", "/proc/net/tcp6", limit);
+    dump_table("UDP sockets (/proc/net/udp)",  "udp",  "/proc/net/udp",  limit);
+    dump_table("UDP6 sockets (/proc/net/udp6)", "udp6", "/proc/net/udp6", limit);
 
-    puts("note: this is read-only and does NOT capture packets.");
+    out_note("note: this is read-only and does NOT capture packets.");
+    out_flush();
     return 0;
-}
\ No newline at end of file
+}
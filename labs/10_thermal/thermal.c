@@ -1,24 +1,18 @@
 // thermal.c - Read thermal zones from /sys/class/thermal (read-only)
 // Tries direct read; falls back to `su -c cat` if blocked.
+// Usage: ./thermal [--uring] [--bench N]
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
 
-static int read_first_line(const char *path, char *out, size_t out_sz) {
-    FILE *fp = fopen(path, "r");
-    if (!fp) return -1;
-
-    if (!fgets(out, (int)out_sz, fp)) {
-        fclose(fp);
-        return -1;
-    }
-    fclose(fp);
-
-    size_t n = strlen(out);
-    if (n && out[n - 1] == '\n') out[n - 1] = '\0';
-    return 0;
-}
+#include "../common/rdbatch.h"
 
 static int read_first_line_su(const char *path, char *out, size_t out_sz) {
     char cmd[256];
@@ -38,12 +32,6 @@ static int read_first_line_su(const char *path, char *out, size_t out_sz) {
     return 0;
 }
 
-static int read_line_auto(const char *path, char *out, size_t out_sz, int *used_su) {
-    if (read_first_line(path, out, out_sz) == 0) { *used_su = 0; return 0; }
-    if (read_first_line_su(path, out, out_sz) == 0) { *used_su = 1; return 0; }
-    return -1;
-}
-
 static double to_celsius(const char *s) {
     long v = strtol(s, NULL, 10);
     // Many Android kernels report millidegrees Celsius
@@ -51,25 +39,93 @@ static double to_celsius(const char *s) {
     return (double)v;
 }
 
-int main(void) {
+#define TZ_MAX 64
+
+static char tz_path[TZ_MAX * 2][64];
+static char tz_buf[TZ_MAX * 2][96];
+static struct rd tz_req[TZ_MAX * 2];
+
+// One sweep = type + temp for every zone, read as a single batch.
+static void thermal_sweep(void) {
+    if (!tz_req[0].path) {
+        for (int i = 0; i < TZ_MAX; i++) {
+            snprintf(tz_path[2*i],   sizeof(tz_path[0]), "/sys/class/thermal/thermal_zone%d/type", i);
+            snprintf(tz_path[2*i+1], sizeof(tz_path[0]), "/sys/class/thermal/thermal_zone%d/temp", i);
+        }
+        for (int i = 0; i < TZ_MAX * 2; i++) {
+            tz_req[i].path = tz_path[i];
+            tz_req[i].buf = tz_buf[i];
+            tz_req[i].cap = sizeof(tz_buf[0]);
+        }
+    }
+    read_batch(tz_req, TZ_MAX * 2);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_one(int iters) {
+    g_syscalls = 0;
+    g_rd_path = 0;
+    double t0 = now_s();
+    for (int i = 0; i < iters; i++) thermal_sweep();
+    double dt = now_s() - t0;
+    printf("%-9s %6d %6d %10.1f %10.1f\n", rd_path_name(), iters, TZ_MAX * 2,
+           (double)g_syscalls / iters, dt * 1e6 / iters);
+}
+
+static int bench(int iters) {
+    puts("== bench: thermal sweep ==");
+    printf("%-9s %6s %6s %10s %10s\n", "backend", "sweeps", "files", "syscalls", "us/sweep");
+
+    g_use_uring = 0;
+    bench_one(iters);
+
+    g_use_uring = 1;
+    if (uring_init() == 0) bench_one(iters);
+    else puts("io_uring  unavailable (kernel < 5.17, seccomp, or disabled)");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--uring")) {
+            g_use_uring = 1;
+        } else if (!strcmp(argv[i], "--bench")) {
+            int n = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+            return bench(n > 0 ? n : 100);
+        }
+    }
+
     puts("== thermal zones ==");
+    if (g_use_uring && uring_init() != 0) {
+        puts("note: io_uring unavailable; using sync reads");
+        g_use_uring = 0;
+    }
+
+    thermal_sweep();
 
     int any = 0;
     int used_su_any = 0;
 
-    for (int i = 0; i < 64; i++) {
-        char type_path[128], temp_path[128];
-        snprintf(type_path, sizeof(type_path), "/sys/class/thermal/thermal_zone%d/type", i);
-        snprintf(temp_path, sizeof(temp_path), "/sys/class/thermal/thermal_zone%d/temp", i);
-
-        char type[96] = {0}, temp_s[96] = {0};
+    for (int i = 0; i < TZ_MAX; i++) {
+        struct rd *type = &tz_req[2*i], *temp = &tz_req[2*i+1];
         int used_su_type = 0, used_su_temp = 0;
 
-        if (read_line_auto(type_path, type, sizeof(type), &used_su_type) != 0) continue;
-        if (read_line_auto(temp_path, temp_s, sizeof(temp_s), &used_su_temp) != 0) continue;
-
-        double c = to_celsius(temp_s);
-        printf("zone%-2d %-18s %6.1f C\n", i, type, c);
+        if (type->res < 0) {
+            if (read_first_line_su(type->path, type->buf, type->cap) != 0) continue;
+            used_su_type = 1;
+        }
+        if (temp->res < 0) {
+            if (read_first_line_su(temp->path, temp->buf, temp->cap) != 0) continue;
+            used_su_temp = 1;
+        }
+
+        double c = to_celsius(temp->buf);
+        printf("zone%-2d %-18s %6.1f C\n", i, type->buf, c);
 
         any = 1;
         if (used_su_type || used_su_temp) used_su_any = 1;
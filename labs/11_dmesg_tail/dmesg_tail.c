@@ -1,8 +1,28 @@
 // dmesg_tail.c - Print last N lines of kernel log (read-only), with su fallback.
+//
+// Build: clang -std=c11 -Wall -Wextra -O2 dmesg_tail.c -o dmesg_tail
+// Run  : ./dmesg_tail 50
+//        ./dmesg_tail --watch patterns.txt            (only records matching a pattern)
+//        ./dmesg_tail --watch --follow --rate 5       (built-in signatures, dmesg -w, 5/min per pattern)
+//        ./dmesg_tail --watch pats.txt --replay saved.log --counts-only
+//        ./dmesg_tail --watch --bench 512             (matcher throughput on 512 MB of synthetic log)
+//        ./dmesg_tail --selftest 5000                 (lane scanner vs naive memmem, random patterns)
+//
+// Pattern file: one "name literal text" per line; '#' starts a comment.
+//   oom        Out of memory: Killed process
+//   avc        avc:  denied
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../common/dmatch.h"
 
 static int read_last_lines_cmd(const char *cmd, int n) {
     FILE *fp = popen(cmd, "r");
@@ -42,12 +62,439 @@ static int read_last_lines_cmd(const char *cmd, int n) {
     return 0;
 }
 
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- scanning ----
+// A chunk of whole records is cut into 4 lanes at record boundaries and the
+// lanes step through the DFA together, so four independent load chains
+// overlap instead of one serial chain. Hits are kept per lane and replayed
+// in lane order, which is file order.
+
+#define LANES 4     // scan_chunk's loop is written out for exactly 4
+
+struct hit { uint32_t pos, st; };
+
+struct hits {
+    struct hit *v;
+    size_t n, cap;
+};
+
+static struct hits lane_hits[LANES];
+
+static void hit_push(struct hits *h, size_t pos, uint32_t st) {
+    if (h->n == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 1024;
+        struct hit *v = realloc(h->v, cap * sizeof(*v));
+        if (!v) return;     // drop the hit rather than the whole run
+        h->v = v;
+        h->cap = cap;
+    }
+    h->v[h->n].pos = (uint32_t)pos;
+    h->v[h->n].st = st;
+    h->n++;
+}
+
+static size_t next_record(const uint8_t *buf, size_t len, size_t at) {
+    if (at >= len) return len;
+    const uint8_t *nl = memchr(buf + at, '\n', len - at);
+    return nl ? (size_t)(nl - buf) + 1 : len;
+}
+
+static void scan_tail(const uint8_t *buf, size_t from, size_t to, uint32_t s, struct hits *h) {
+    const uint32_t *D = am.delta, acc = am.acc;
+    for (size_t i = from; i < to; i++) {
+        s = D[s | buf[i]];
+        if (__builtin_expect(s >= acc, 0)) hit_push(h, i, s);
+    }
+}
+
+static void scan_chunk(const uint8_t *buf, size_t len) {
+    size_t b[LANES + 1];
+    b[0] = 0;
+    for (int l = 1; l < LANES; l++) b[l] = next_record(buf, len, len * l / LANES);
+    b[LANES] = len;
+    for (int l = 1; l <= LANES; l++) if (b[l] < b[l - 1]) b[l] = b[l - 1];
+    for (int l = 0; l < LANES; l++) lane_hits[l].n = 0;
+
+    size_t m = len;
+    for (int l = 0; l < LANES; l++) if (b[l + 1] - b[l] < m) m = b[l + 1] - b[l];
+
+    const uint32_t *D = am.delta, acc = am.acc;
+    const uint8_t *p0 = buf + b[0], *p1 = buf + b[1], *p2 = buf + b[2], *p3 = buf + b[3];
+    uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (size_t i = 0; i < m; i++) {
+        s0 = D[s0 | p0[i]];
+        s1 = D[s1 | p1[i]];
+        s2 = D[s2 | p2[i]];
+        s3 = D[s3 | p3[i]];
+        if (__builtin_expect((s0 | s1 | s2 | s3) >= acc, 0)) {
+            if (s0 >= acc) hit_push(&lane_hits[0], b[0] + i, s0);
+            if (s1 >= acc) hit_push(&lane_hits[1], b[1] + i, s1);
+            if (s2 >= acc) hit_push(&lane_hits[2], b[2] + i, s2);
+            if (s3 >= acc) hit_push(&lane_hits[3], b[3] + i, s3);
+        }
+    }
+    scan_tail(buf, b[0] + m, b[1], s0, &lane_hits[0]);
+    scan_tail(buf, b[1] + m, b[2], s1, &lane_hits[1]);
+    scan_tail(buf, b[2] + m, b[3], s2, &lane_hits[2]);
+    scan_tail(buf, b[3] + m, b[4], s3, &lane_hits[3]);
+}
+
+// ---- records ----
+
+static int rate_n = 0;              // per pattern per rate_win seconds, 0 = unlimited
+static const double rate_win = 60;
+static int quiet = 0;
+static unsigned long rec_matched, rec_emitted;
+
+// "[  123.456789] ..." -> 123.456789; no stamp (replayed text) -> wall time.
+static double record_time(const uint8_t *p, size_t n) {
+    if (n > 2 && p[0] == '[') {
+        char *end;
+        double t = strtod((const char *)p + 1, &end);
+        if (end != (const char *)p + 1 && *end == ']') return t;
+    }
+    return now_s();
+}
+
+static void emit_record(const uint8_t *p, size_t n, const uint64_t *set) {
+    double t = record_time(p, n);
+    int allowed = 0;
+    char names[256];
+    size_t nl = 0;
+    uint64_t named[PAT_MAX / 64] = { 0 };
+
+    for (int w = 0; w < PAT_MAX / 64; w++) {
+        for (uint64_t bits = set[w]; bits; bits &= bits - 1) {
+            struct pattern *pt = &pats[w * 64 + __builtin_ctzll(bits)];
+            pt->matched++;
+            if (t - pt->win_start >= rate_win || t < pt->win_start) {
+                pt->win_start = t;
+                pt->win_count = 0;
+            }
+            if (rate_n && pt->win_count >= rate_n) { pt->suppressed++; continue; }
+            pt->win_count++;
+            pt->emitted++;
+            allowed = 1;
+            am_add_name(names, sizeof(names), &nl, named, pt);
+        }
+    }
+    rec_matched++;
+    if (!allowed) return;
+    rec_emitted++;
+    if (quiet) return;
+
+    printf("[%.*s] ", (int)nl, names);
+    fwrite(p, 1, n, stdout);
+    if (!n || p[n - 1] != '\n') putchar('\n');
+}
+
+// Where classified records go; --selftest swaps in its oracle check.
+static void (*on_record)(const uint8_t *p, size_t n, const uint64_t *set) = emit_record;
+
+// Hits -> records: collapse every hit inside one record into a pattern set.
+static void classify_chunk(const uint8_t *buf, size_t len) {
+    size_t cur = SIZE_MAX, cur_end = 0;
+    uint64_t set[PAT_MAX / 64] = { 0 };
+
+    for (int l = 0; l < LANES; l++) {
+        for (size_t i = 0; i < lane_hits[l].n; i++) {
+            size_t pos = lane_hits[l].v[i].pos;
+            if (cur == SIZE_MAX || pos >= cur_end) {
+                if (cur != SIZE_MAX) on_record(buf + cur, cur_end - cur, set);
+                memset(set, 0, sizeof(set));
+                const uint8_t *nl = memrchr(buf, '\n', pos);
+                cur = nl ? (size_t)(nl - buf) + 1 : 0;
+                cur_end = next_record(buf, len, pos);
+            }
+            uint32_t a = (lane_hits[l].v[i].st - am.acc) >> 8;
+            for (uint32_t o = am.out_at[a]; o < am.out_at[a + 1]; o++)
+                set[am.outs[o] / 64] |= 1ull << (am.outs[o] % 64);
+        }
+    }
+    if (cur != SIZE_MAX) on_record(buf + cur, cur_end - cur, set);
+}
+
+// ---- watch ----
+
+#define WATCH_BUF (1 << 20)
+
+static unsigned long long watch_bytes;
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_on_signal(int sig) { (void)sig; watch_stop = 1; }
+
+// Feeds fd through the matcher in chunks of whole records. read() rather
+// than stdio so a following pipe (dmesg -w) is handled as data arrives.
+static int watch_fd(int fd) {
+    uint8_t *buf = malloc(WATCH_BUF);
+    if (!buf) return -1;
+    size_t have = 0;
+
+    for (;;) {
+        ssize_t r = read(fd, buf + have, WATCH_BUF - have);
+        if (r < 0 && errno == EINTR && watch_stop) break;
+        if (r < 0) { free(buf); return -1; }
+        if (r == 0) break;
+        have += (size_t)r;
+        watch_bytes += (unsigned long long)r;
+
+        const uint8_t *nl = memrchr(buf, '\n', have);
+        size_t cut = nl ? (size_t)(nl - buf) + 1 : (have == WATCH_BUF ? have : 0);
+        if (!cut) continue;
+        scan_chunk(buf, cut);
+        classify_chunk(buf, cut);
+        memmove(buf, buf + cut, have - cut);
+        have -= cut;
+        fflush(stdout);
+    }
+    if (have) {
+        scan_chunk(buf, have);
+        classify_chunk(buf, have);
+    }
+    free(buf);
+    return 0;
+}
+
+static int watch_cmd(const char *cmd) {
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return -1;
+    unsigned long long before = watch_bytes;
+    int rc = watch_fd(fileno(fp));
+    pclose(fp);
+    return rc == 0 && watch_bytes > before ? 0 : -1;
+}
+
+static void print_counters(double secs) {
+    printf("\n== watch summary ==\n");
+    printf("%-16s %10s %10s %10s\n", "pattern", "matched", "emitted", "suppressed");
+    for (int i = 0; i < npats; i++) {
+        if (pats[i].first != i) continue;   // same name on several literals: report once, summed
+        unsigned long m = 0, e = 0, s = 0;
+        for (int j = i; j < npats; j++) {
+            if (pats[j].first != i) continue;
+            m += pats[j].matched; e += pats[j].emitted; s += pats[j].suppressed;
+        }
+        if (m) printf("%-16s %10lu %10lu %10lu\n", pats[i].name, m, e, s);
+    }
+    printf("records: %lu matched, %lu emitted\n", rec_matched, rec_emitted);
+    if (secs > 0)
+        printf("scanned: %.2f MB in %.3fs (%.2f GB/s)\n",
+               watch_bytes / 1e6, secs, watch_bytes / secs / 1e9);
+}
+
+// Synthetic kernel log with a signature roughly every 500 records.
+static void run_bench(int mb) {
+    static const char *noise[] = {
+        "binder: 1234:5678 transaction failed 29189/-22, size 0-0 line 3031",
+        "healthd: battery l=87 v=4211 t=29.6 h=2 st=3 c=-312000 fc=4386000 cc=112 chg=",
+        "init: Service 'vendor.camera-provider' (pid 812) exited with status 0",
+        "audit: type=1400 audit(1700000000.123:4567): avc:  granted  { read } for pid=1",
+        "wlan: [1234:I:HDD] hdd_cfg80211_get_station: 4412: Rx rate: 866700 kbps",
+        "CPU4: update max cpu_capacity 1024",
+        "usb 1-1: new high-speed USB device number 3 using xhci-hcd",
+        "ufshcd-qcom 1d84000.ufshc: ufshcd_print_pwr_info:[RX, TX]: gear=[4, 4], lane[2, 2]",
+        "sched: RT throttling activated for cpu 2",
+        "EXT4-fs (dm-5): mounted filesystem with ordered data mode. Opts: barrier=1",
+    };
+    static const char *sig[] = {
+        "Out of memory: Killed process 4321 (com.example.app) total-vm:4096kB",
+        "audit: type=1400 audit(1700000000.456:4568): avc:  denied  { write } for pid=2",
+        "thermal thermal_zone12: critical temperature reached (115 C), shutting down",
+        "blk_update_request: I/O error, dev mmcblk0, sector 123456 op 0x0:(READ)",
+        "watchdog: BUG: soft lockup - CPU#3 stuck for 22s! [kworker/3:1:77]",
+    };
+    size_t len = (size_t)mb << 20;
+    char *buf = malloc(len + 256);
+    if (!buf) { perror("malloc"); return; }
+
+    size_t at = 0;
+    unsigned x = 12345;
+    double ts = 0;
+    while (at < len) {
+        x = x * 1103515245u + 12345u;
+        const char *msg = (x >> 16) % 500 == 0 ? sig[(x >> 8) % 5] : noise[(x >> 8) % 10];
+        ts += 0.000731;
+        int k = snprintf(buf + at, len + 256 - at, "[%12.6f] %s\n", ts, msg);
+        if (k <= 0) break;
+        at += (size_t)k;
+    }
+    if (at > len) at = len;
+
+    printf("== matcher bench: %d patterns, %u states, %.0f MB ==\n", npats, am.nstates, at / 1e6);
+    quiet = 1;
+    double t0 = now_s();
+    for (size_t off = 0; off < at; ) {
+        size_t cut = off + WATCH_BUF < at ? next_record((uint8_t *)buf, off + WATCH_BUF, off + WATCH_BUF - 1) : at;
+        if (cut <= off) cut = at;
+        scan_chunk((uint8_t *)buf + off, cut - off);
+        classify_chunk((uint8_t *)buf + off, cut - off);
+        off = cut;
+    }
+    watch_bytes = at;
+    print_counters(now_s() - t0);
+    free(buf);
+}
+
+// ---- self-test ----
+// --selftest checks the lane scanner against a naive oracle. Each round
+// draws a pattern set over a 3-letter alphabet (so literals overlap and
+// share prefixes and suffixes) and random records over a wider one. Every record that the scanner reports must carry exactly the
+// patterns memmem() finds in it, and every record memmem() matches must
+// be reported.
+
+static unsigned long st_seen, st_bad;
+static uint64_t st_rng = 0x9e3779b97f4a7c15ull;
+
+static unsigned st_rand(unsigned n) {
+    st_rng ^= st_rng << 13;
+    st_rng ^= st_rng >> 7;
+    st_rng ^= st_rng << 17;
+    return (unsigned)(st_rng % n);
+}
+
+static void st_oracle(const uint8_t *p, size_t n, uint64_t *set) {
+    memset(set, 0, PAT_MAX / 8);
+    for (int i = 0; i < npats; i++)
+        if (memmem(p, n, pats[i].lit, (size_t)pats[i].len)) set[i / 64] |= 1ull << (i % 64);
+}
+
+static void st_record(const uint8_t *p, size_t n, const uint64_t *set) {
+    uint64_t want[PAT_MAX / 64];
+    st_oracle(p, n, want);
+    st_seen++;
+    if (!memcmp(want, set, sizeof(want))) return;
+    if (st_bad++ < 5) printf("mismatch on record \"%.*s\"\n", (int)(n && p[n - 1] == '\n' ? n - 1 : n), p);
+}
+
+static int run_selftest(int rounds) {
+    static char lit[8], buf[64 * 1024];
+    unsigned long records = 0, matched = 0;
+    on_record = st_record;
+
+    for (int r = 0; r < rounds; r++) {
+        npats = 0;
+        int k = 1 + (int)st_rand(48);
+        for (int i = 0; i < k; i++) {
+            int len = i % 8 || r % 4 ? 3 + (int)st_rand(5) : 1 + (int)st_rand(2);
+            for (int j = 0; j < len; j++) lit[j] = "abc"[st_rand(3)];
+            lit[len] = 0;
+            char name[16];
+            snprintf(name, sizeof(name), "p%d", i);
+            add_pattern(name, lit);
+        }
+        if (am_build() != 0) { perror("am_build"); return 1; }
+
+        // From one short record (lanes mostly empty) to ~40 KB.
+        size_t len = 0;
+        int nrec = 1 + (int)st_rand(r % 8 ? 64 : 1000);
+        for (int i = 0; i < nrec; i++) {
+            int rl = (int)st_rand(48);
+            for (int j = 0; j < rl; j++) buf[len++] = "abcdef "[st_rand(7)];
+            if (i < nrec - 1 || st_rand(2)) buf[len++] = '\n';
+        }
+
+        unsigned long want = 0, seen0 = st_seen;
+        for (size_t at = 0; at < len; ) {
+            size_t end = next_record((const uint8_t *)buf, len, at);
+            uint64_t set[PAT_MAX / 64];
+            st_oracle((const uint8_t *)buf + at, end - at, set);
+            for (int w = 0; w < PAT_MAX / 64; w++) if (set[w]) { want++; break; }
+            records++;
+            at = end;
+        }
+        scan_chunk((const uint8_t *)buf, len);
+        classify_chunk((const uint8_t *)buf, len);
+        matched += want;
+        if (st_seen - seen0 != want) {
+            if (st_bad++ < 5) printf("round %d: %lu records reported, oracle matched %lu\n", r, st_seen - seen0, want);
+        }
+    }
+
+    printf("selftest: %d rounds, %lu records, %lu matching: %s\n", rounds, records, matched,
+           st_bad ? "FAIL" : "ok");
+    return st_bad ? 1 : 0;
+}
+
+static int run_watch(const char *replay, int follow, int bench_mb) {
+    if (bench_mb) { run_bench(bench_mb); return 0; }
+
+    double t0 = now_s();
+    int rc;
+    if (replay) {
+        FILE *fp = strcmp(replay, "-") ? fopen(replay, "r") : stdin;
+        if (!fp) { perror(replay); return 1; }
+        rc = watch_fd(fileno(fp));
+        if (fp != stdin) fclose(fp);
+    } else {
+        // No SA_RESTART: Ctrl-C interrupts the blocking read so the
+        // summary still prints when following.
+        struct sigaction sa = { .sa_handler = watch_on_signal };
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        printf("== dmesg watch (%d patterns%s) ==\n", npats, follow ? ", following" : "");
+        fflush(stdout);
+        const char *cmds[] = {
+            follow ? "dmesg -w 2>/dev/null" : "dmesg 2>/dev/null",
+            follow ? "su -c 'dmesg -w' 2>/dev/null" : "su -c dmesg 2>/dev/null",
+        };
+        rc = watch_cmd(cmds[0]);
+        if (rc != 0) rc = watch_cmd(cmds[1]);
+        if (rc != 0) {
+            puts("failed: dmesg is blocked (try: su -c ./dmesg_tail --watch)");
+            return 1;
+        }
+    }
+    print_counters(now_s() - t0);
+    return rc == 0 ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
     int n = 50;
-    if (argc >= 2) {
-        n = atoi(argv[1]);
-        if (n <= 0) n = 50;
-        if (n > 500) n = 500; // keep it sane on phones
+    int watch = 0, follow = 0, bench_mb = 0, selftest = 0;
+    const char *pat_file = NULL, *replay = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--watch")) {
+            watch = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') pat_file = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (!strcmp(argv[i], "--follow")) {
+            follow = 1;
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate_n = atoi(argv[++i]);
+            if (rate_n < 0) rate_n = 0;
+        } else if (!strcmp(argv[i], "--counts-only")) {
+            quiet = 1;
+        } else if (!strcmp(argv[i], "--selftest")) {
+            selftest = 2000;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) selftest = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench")) {
+            bench_mb = 256;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) bench_mb = atoi(argv[++i]);
+            if (bench_mb > 4095) bench_mb = 4095;
+        } else {
+            n = atoi(argv[i]);
+            if (n <= 0) n = 50;
+            if (n > 500) n = 500; // keep it sane on phones
+        }
+    }
+
+    if (selftest) return run_selftest(selftest);
+
+    if (watch || replay || bench_mb) {
+        if (load_patterns(pat_file) != 0) {
+            if (pat_file) perror(pat_file);
+            return 1;
+        }
+        if (am_build() != 0) { perror("am_build"); return 1; }
+        return run_watch(replay, follow, bench_mb);
     }
 
     puts("== dmesg tail ==");
@@ -65,4 +512,4 @@ int main(int argc, char **argv) {
 
     puts("failed: dmesg is blocked (try: su -c ./dmesg_tail 50)");
     return 1;
-}
\ No newline at end of file
+}
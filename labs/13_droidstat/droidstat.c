@@ -4,13 +4,59 @@
 // Build: clang -std=c11 -Wall -Wextra -O2 droidstat.c -o droidstat
 // Run  : ./droidstat
 //       ./droidstat --dmesg 30
+//       ./droidstat --dmesg 30 --watch pats.txt  (only records matching a pattern, with counts)
+//       ./droidstat --uring          (batch sysfs reads through io_uring)
+//       ./droidstat --bench 200      (compare sync vs io_uring thermal sweeps)
+//       ./droidstat --export tcp:9101 --interval 5
+//       ./droidstat --export unix:/data/local/tmp/droidstat.sock
+//                                    (OpenMetrics over HTTP, cached between refreshes)
+//       ./droidstat --snapshot > snap.txt (structured record for ../14_fleetagg)
+//       ./droidstat --sample 10 --report 60
+//                                    (long-running: 1m/15m/1h min/mean/p50/p95/p99/max)
+//       ./droidstat --sample 2 --publish droidstat
+//                                    (latest sample in /dev/shm/droidstat; read with ../16_shmsnap)
+//       ./droidstat --selftest       (dmesg tail/watch on canned input; nonzero exit on failure)
+//       ./droidstat --self-profile       (per-section cost table; =json: JSON lines on stderr)
+//       ./droidstat --sample 10 --budget 0.5 [--budget-io KB] [--idle] [--cpu N]
+//                                    (continuous modes: stay under 0.5% of one core by
+//                                     slowing the costliest sources; SCHED_IDLE, pinning)
 
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
 #include <sys/utsname.h>
+#include <linux/perf_event.h>
+
+#include "dsshm.h"
+#include "../common/dsgov.h"
+
+static void prof_file(int ok, unsigned long bytes);
+#define RD_ACCOUNT(ok, bytes) prof_file(ok, bytes)      // batch reads count in --self-profile
+#include "../common/rdbatch.h"
+#include "../common/dmatch.h"
+#include "../common/kvfile.h"
 
 static void hr(void) { puts("----------------------------------------"); }
 
@@ -19,11 +65,154 @@ static void trim(char *s) {
     if (n && s[n-1] == '\n') s[n-1] = '\0';
 }
 
+// ---- self-profile ----
+// Every low-level reader charges its opens/bytes/spawns/failures to the
+// current section. With --self-profile the sec_* functions are also timed
+// (wall, own CPU, children's CPU) and, when perf_event_open is allowed,
+// user-space instructions and cycles are counted.
+
+struct prof_sec {
+    const char *name;
+    double wall_s, cpu_s, child_s;
+    unsigned long opens, bytes, spawns, fails;
+    long long instr, cycles;            // -1 = not available
+    double w0, c0, ch0;
+    long long i0, cy0;
+};
+
+#define PROF_MAX 16
+
+static struct prof_sec prof[PROF_MAX] = { { .name = "other", .instr = -1, .cycles = -1 } };
+static int prof_n = 1;
+static struct prof_sec *prof_cur = &prof[0];
+static int g_profile = 0;               // 0 = off, 1 = table, 2 = JSON lines
+static int perf_fd = -1;                // group leader: instructions; member: cycles
+
+static void prof_file(int ok, unsigned long bytes) {
+    prof_cur->opens++;
+    if (ok) prof_cur->bytes += bytes;
+    else prof_cur->fails++;
+}
+
+static void prof_spawn(int ok, unsigned long bytes) {
+    prof_cur->spawns++;
+    if (ok) prof_cur->bytes += bytes;
+    else prof_cur->fails++;
+}
+
+static long perf_open(uint64_t config, int group) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.exclude_kernel = 1;       // user-only works at perf_event_paranoid <= 2
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &a, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void prof_init(void) {
+    int lead = (int)perf_open(PERF_COUNT_HW_INSTRUCTIONS, -1);
+    if (lead < 0) return;
+    if (perf_open(PERF_COUNT_HW_CPU_CYCLES, lead) < 0) { close(lead); return; }
+    ioctl(lead, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    perf_fd = lead;
+}
+
+static int perf_read(long long *instr, long long *cycles) {
+    struct { uint64_t nr, v[2]; } g;
+    if (perf_fd < 0 || read(perf_fd, &g, sizeof(g)) != (ssize_t)sizeof(g)) return -1;
+    *instr = (long long)g.v[0];
+    *cycles = (long long)g.v[1];
+    return 0;
+}
+
+static double cpu_s(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double child_cpu_s(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void prof_begin(const char *name) {
+    struct prof_sec *p = NULL;
+    for (int i = 0; i < prof_n; i++) if (!strcmp(prof[i].name, name)) p = &prof[i];
+    if (!p && prof_n < PROF_MAX) {
+        p = &prof[prof_n++];
+        p->name = name;
+        p->instr = p->cycles = -1;
+    }
+    if (!p) return;
+    prof_cur = p;
+    if (!g_profile) return;
+
+    p->w0 = cpu_s(CLOCK_MONOTONIC);
+    p->c0 = cpu_s(CLOCK_PROCESS_CPUTIME_ID);
+    p->ch0 = child_cpu_s();
+    if (perf_read(&p->i0, &p->cy0) != 0) p->i0 = -1;
+}
+
+static void prof_end(void) {
+    struct prof_sec *p = prof_cur;
+    prof_cur = &prof[0];
+    if (!g_profile || p == &prof[0]) return;
+
+    p->wall_s  += cpu_s(CLOCK_MONOTONIC) - p->w0;
+    p->cpu_s   += cpu_s(CLOCK_PROCESS_CPUTIME_ID) - p->c0;
+    p->child_s += child_cpu_s() - p->ch0;
+
+    long long i1, cy1;
+    if (p->i0 >= 0 && perf_read(&i1, &cy1) == 0) {
+        p->instr  = (p->instr  < 0 ? 0 : p->instr)  + (i1 - p->i0);
+        p->cycles = (p->cycles < 0 ? 0 : p->cycles) + (cy1 - p->cy0);
+    }
+}
+
+// Table goes to stdout with the report; JSON lines go to stderr so they can
+// be captured separately (2> prof.jsonl).
+static void prof_report(void) {
+    if (g_profile == 2) {
+        for (int i = 0; i < prof_n; i++) {
+            const struct prof_sec *p = &prof[i];
+            if (!i && !p->opens && !p->spawns) continue;
+            fprintf(stderr, "{\"section\":\"%s\",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"child_cpu_ms\":%.3f,"
+                   "\"opens\":%lu,\"bytes\":%lu,\"spawns\":%lu,\"fails\":%lu,"
+                   "\"instructions\":%lld,\"cycles\":%lld}\n",
+                   p->name, p->wall_s * 1e3, p->cpu_s * 1e3, p->child_s * 1e3,
+                   p->opens, p->bytes, p->spawns, p->fails, p->instr, p->cycles);
+        }
+        return;
+    }
+
+    puts("== self-profile ==");
+    printf("%-10s %9s %8s %8s %6s %8s %6s %6s %12s %12s\n", "section", "wall_ms", "cpu_ms",
+           "child_ms", "opens", "bytes", "spawns", "fails", "instr", "cycles");
+    for (int i = 0; i < prof_n; i++) {
+        const struct prof_sec *p = &prof[i];
+        if (!i && !p->opens && !p->spawns) continue;   // nothing ran outside a section
+        char in[24] = "n/a", cy[24] = "n/a";
+        if (p->instr >= 0) snprintf(in, sizeof(in), "%lld", p->instr);
+        if (p->cycles >= 0) snprintf(cy, sizeof(cy), "%lld", p->cycles);
+        printf("%-10s %9.3f %8.3f %8.3f %6lu %8lu %6lu %6lu %12s %12s\n", p->name,
+               p->wall_s * 1e3, p->cpu_s * 1e3, p->child_s * 1e3,
+               p->opens, p->bytes, p->spawns, p->fails, in, cy);
+    }
+    if (perf_fd < 0) puts("note: hardware counters unavailable (perf_event_paranoid / seccomp)");
+    hr();
+}
+
 static int run_line(const char *cmd, char *out, size_t out_sz) {
     FILE *fp = popen(cmd, "r");
-    if (!fp) return -1;
-    if (!fgets(out, (int)out_sz, fp)) { pclose(fp); return -1; }
+    if (!fp) { prof_spawn(0, 0); return -1; }
+    if (!fgets(out, (int)out_sz, fp)) { pclose(fp); prof_spawn(0, 0); return -1; }
     pclose(fp);
+    prof_spawn(1, strlen(out));
     trim(out);
     return 0;
 }
@@ -67,16 +256,17 @@ static void sec_uptime(void) {
 
 static long long read_mem_kb(const char *key) {
     FILE *fp = fopen("/proc/meminfo", "r");
-    if (!fp) return -1;
+    if (!fp) { prof_file(0, 0); return -1; }
 
     char k[64], unit[16];
-    long long v = 0;
+    long long v = 0, found = -1;
     while (fscanf(fp, "%63s %lld %15s", k, &v, unit) == 3) {
         if (strcmp(unit, "kB") != 0) continue;
-        if (!strcmp(k, key)) { fclose(fp); return v; }
+        if (!strcmp(k, key)) { found = v; break; }
     }
+    prof_file(1, (unsigned long)ftell(fp));
     fclose(fp);
-    return -1;
+    return found;
 }
 
 static void sec_mem(void) {
@@ -99,14 +289,7 @@ static void sec_mem(void) {
     hr();
 }
 
-static int read_sys_line(const char *path, char *out, size_t out_sz) {
-    FILE *fp = fopen(path, "r");
-    if (fp) {
-        if (!fgets(out, (int)out_sz, fp)) { fclose(fp); return -1; }
-        fclose(fp);
-        trim(out);
-        return 0;
-    }
+static int read_sys_su(const char *path, char *out, size_t out_sz) {
     // su fallback (read-only)
     char cmd[256];
     snprintf(cmd, sizeof(cmd), "su -c cat %s 2>/dev/null", path);
@@ -120,71 +303,1024 @@ static double to_celsius(const char *s) {
     return (double)v;
 }
 
-static void sec_thermal(void) {
-    puts("== thermal ==");
-    int any = 0;
-    for (int i = 0; i < 32; i++) {
-        char type_p[128], temp_p[128];
-        snprintf(type_p, sizeof(type_p), "/sys/class/thermal/thermal_zone%d/type", i);
-        snprintf(temp_p, sizeof(temp_p), "/sys/class/thermal/thermal_zone%d/temp", i);
+#define TZ_MAX 32
+
+static char tz_path[TZ_MAX * 2][64];
+static char tz_buf[TZ_MAX * 2][96];
+static struct rd tz_req[TZ_MAX * 2];
+
+// One sweep = type + temp for every zone, read as a single batch.
+static void thermal_sweep(void) {
+    if (!tz_req[0].path) {
+        for (int i = 0; i < TZ_MAX; i++) {
+            snprintf(tz_path[2*i],   sizeof(tz_path[0]), "/sys/class/thermal/thermal_zone%d/type", i);
+            snprintf(tz_path[2*i+1], sizeof(tz_path[0]), "/sys/class/thermal/thermal_zone%d/temp", i);
+        }
+        for (int i = 0; i < TZ_MAX * 2; i++) {
+            tz_req[i].path = tz_path[i];
+            tz_req[i].buf = tz_buf[i];
+            tz_req[i].cap = sizeof(tz_buf[0]);
+        }
+    }
+    read_batch(tz_req, TZ_MAX * 2);
+}
+
+// ---- snapshot ----
+// Plain numbers for the non-report modes (exporter, ...). -1 = unknown.
+
+struct zone {
+    int id;
+    char type[48];
+    double c;
+};
 
-        char type[96] = {0}, temp[96] = {0};
-        if (read_sys_line(type_p, type, sizeof(type)) != 0) continue;
-        if (read_sys_line(temp_p, temp, sizeof(temp)) != 0) continue;
+struct snapshot {
+    double uptime_s;
+    long long mem_total, mem_free, mem_avail, mem_cached;   // kB
+    double load[3];
+    int nr_running, nr_tasks;
+    int nzones;
+    struct zone zone[TZ_MAX];
+};
 
-        printf("zone%-2d %-18s %6.1f C\n", i, type, to_celsius(temp));
-        any = 1;
+static void collect_uptime(struct snapshot *s) {
+    struct timespec ts;
+    s->uptime_s = -1;
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) s->uptime_s = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void collect_mem(struct snapshot *s) {
+    s->mem_total  = read_mem_kb("MemTotal:");
+    s->mem_free   = read_mem_kb("MemFree:");
+    s->mem_avail  = read_mem_kb("MemAvailable:");
+    s->mem_cached = read_mem_kb("Cached:");
+}
+
+static void collect_load(struct snapshot *s) {
+    s->load[0] = s->load[1] = s->load[2] = -1;
+    s->nr_running = s->nr_tasks = -1;
+
+    FILE *fp = fopen("/proc/loadavg", "r");
+    if (fp) {
+        int ok = fscanf(fp, "%lf %lf %lf %d/%d", &s->load[0], &s->load[1], &s->load[2],
+                        &s->nr_running, &s->nr_tasks) == 5;
+        prof_file(ok, (unsigned long)ftell(fp));
+        fclose(fp);
+        if (ok) return;
+    } else {
+        prof_file(0, 0);
     }
 
-    if (!any) {
+    // Fallback: sysinfo() load averages (scaled integers)
+    struct sysinfo si;
+    if (sysinfo(&si) == 0) {
+        const double scale = (double)(1 << SI_LOAD_SHIFT);
+        for (int i = 0; i < 3; i++) s->load[i] = si.loads[i] / scale;
+        s->nr_tasks = si.procs;
+    }
+}
+
+static void collect_thermal(struct snapshot *s, int allow_su) {
+    thermal_sweep();
+
+    s->nzones = 0;
+    for (int i = 0; i < TZ_MAX; i++) {
+        struct rd *type = &tz_req[2*i], *temp = &tz_req[2*i+1];
+        if (type->res < 0 && (!allow_su || read_sys_su(type->path, type->buf, type->cap) != 0)) continue;
+        if (temp->res < 0 && (!allow_su || read_sys_su(temp->path, temp->buf, temp->cap) != 0)) continue;
+
+        struct zone *z = &s->zone[s->nzones++];
+        z->id = i;
+        snprintf(z->type, sizeof(z->type), "%s", type->buf);
+        z->c = to_celsius(temp->buf);
+    }
+}
+
+static void sec_thermal(void) {
+    puts("== thermal ==");
+    struct snapshot s;
+    collect_thermal(&s, 1);
+
+    for (int i = 0; i < s.nzones; i++)
+        printf("zone%-2d %-18s %6.1f C\n", s.zone[i].id, s.zone[i].type, s.zone[i].c);
+
+    if (!s.nzones) {
         puts("no thermal zones readable (blocked?)");
         puts("hint: try: su -c ./droidstat");
     }
     hr();
 }
 
-static int tail_cmd(const char *cmd, int n) {
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return -1;
+// ---- rolling statistics ----
+// Fixed memory per metric, O(1) update. Each window (1m, 15m, 1h) is a ring
+// of 60 slots; a slot keeps count/sum/min/max and a 128-bin linear
+// histogram over the metric's [lo, hi) range. The window also keeps the sum
+// of its live slots' bins (an expiring slot is subtracted), so a percentile
+// query scans 128 bins once instead of merging 60 histograms.
+
+#define RS_BINS  128
+#define RS_SLOTS 60
+#define RS_WIN   3
+
+static const int rs_slot_s[RS_WIN] = { 1, 15, 60 };
+static const char *rs_win_name[RS_WIN] = { "1m", "15m", "1h" };
+
+struct rs_win {
+    long long cur;              // absolute slot number held by index cur % RS_SLOTS; -1 = empty
+    uint32_t n[RS_SLOTS];
+    float min[RS_SLOTS], max[RS_SLOTS];   // +/-FLT_MAX while empty
+    double sum[RS_SLOTS];
+    uint32_t bin[RS_BINS];
+    uint16_t sbin[RS_SLOTS][RS_BINS];   // <= 60 s per slot at <= 100 Hz: fits
+};
+
+struct rstat {
+    double lo, width;
+    struct rs_win w[RS_WIN];
+};
+
+struct rs_result {
+    uint32_t n;
+    double min, mean, p50, p95, p99, max;
+};
+
+static void rs_reset_win(struct rs_win *w, long long cur) {
+    memset(w, 0, sizeof(*w));
+    for (int i = 0; i < RS_SLOTS; i++) { w->min[i] = FLT_MAX; w->max[i] = -FLT_MAX; }
+    w->cur = cur;
+}
+
+static void rs_init(struct rstat *r, double lo, double hi) {
+    memset(r, 0, sizeof(*r));
+    r->lo = lo;
+    r->width = (hi > lo ? hi - lo : 1.0) / RS_BINS;
+    for (int i = 0; i < RS_WIN; i++) rs_reset_win(&r->w[i], -1);
+}
+
+static void rs_clear_slot(struct rs_win *w, int i) {
+    if (!w->n[i]) return;
+    for (int b = 0; b < RS_BINS; b++) w->bin[b] -= w->sbin[i][b];
+    memset(w->sbin[i], 0, sizeof(w->sbin[i]));
+    w->n[i] = 0;
+    w->sum[i] = 0;
+    w->min[i] = FLT_MAX;
+    w->max[i] = -FLT_MAX;
+}
+
+// Moves the window head to absolute slot `no`, expiring what fell out.
+static void rs_advance(struct rs_win *w, long long no) {
+    if (w->cur < 0) { w->cur = no; return; }
+    if (no <= w->cur) return;
+
+    if (no - w->cur >= RS_SLOTS) { rs_reset_win(w, no); return; }
+    for (long long k = w->cur + 1; k <= no; k++) rs_clear_slot(w, (int)(k % RS_SLOTS));
+    w->cur = no;
+}
+
+// t = seconds on a monotonic clock.
+static void rs_add(struct rstat *r, double t, double v) {
+    int b = (int)((v - r->lo) / r->width);
+    if (b < 0) b = 0;
+    if (b >= RS_BINS) b = RS_BINS - 1;
+
+    for (int k = 0; k < RS_WIN; k++) {
+        struct rs_win *w = &r->w[k];
+        rs_advance(w, (long long)(t / rs_slot_s[k]));
+        int i = (int)(w->cur % RS_SLOTS);
+        if (v < w->min[i]) w->min[i] = (float)v;
+        if (v > w->max[i]) w->max[i] = (float)v;
+        w->n[i]++;
+        w->sum[i] += v;
+        w->sbin[i][b]++;
+        w->bin[b]++;
+    }
+}
+
+// Ages the window to `t` first, so a metric that stopped updating empties out.
+static void rs_query(struct rstat *r, int win, double t, struct rs_result *out) {
+    struct rs_win *w = &r->w[win];
+    memset(out, 0, sizeof(*out));
+    if (w->cur < 0) return;
+    rs_advance(w, (long long)(t / rs_slot_s[win]));
+
+    // Empty slots hold n = 0 and +/-FLT_MAX, so this loop needs no branches.
+    uint32_t n = 0;
+    double sum = 0;
+    float mn = FLT_MAX, mx = -FLT_MAX;
+    for (int i = 0; i < RS_SLOTS; i++) {
+        n += w->n[i];
+        sum += w->sum[i];
+        mn = w->min[i] < mn ? w->min[i] : mn;
+        mx = w->max[i] > mx ? w->max[i] : mx;
+    }
+    if (!n) return;
+    out->n = n;
+    out->min = mn;
+    out->max = mx;
+    out->mean = sum / n;
+
+    // One pass over the bins for all three ranks, interpolating inside a bin.
+    // The edge bins also hold out-of-range values, so they stretch to min/max.
+    static const double q[3] = { 0.50, 0.95, 0.99 };
+    double *p[3] = { &out->p50, &out->p95, &out->p99 };
+    double rank[3] = { q[0] * n, q[1] * n, q[2] * n };
+    uint32_t seen = 0;
+    int k = 0;
+    for (int b = 0; b < RS_BINS; b++) {
+        uint32_t next = seen + w->bin[b];
+        while (next >= rank[k]) {
+            double blo = r->lo + b * r->width, bhi = blo + r->width;
+            if (b == 0 && out->min < blo) blo = out->min;
+            if (b == RS_BINS - 1 && out->max > bhi) bhi = out->max;
+            *p[k] = blo + (rank[k] - seen) / w->bin[b] * (bhi - blo);
+            if (++k == 3) goto done;
+        }
+        seen = next;
+    }
+done:
+    // Bins are coarse; exact extremes bound the estimates.
+    for (int i = 0; i < 3; i++) {
+        if (*p[i] < out->min) *p[i] = out->min;
+        if (*p[i] > out->max) *p[i] = out->max;
+    }
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_one(int iters) {
+    g_syscalls = 0;
+    g_rd_path = 0;
+    double t0 = now_s();
+    for (int i = 0; i < iters; i++) thermal_sweep();
+    double dt = now_s() - t0;
+    printf("%-9s %6d %6d %10.1f %10.1f\n", rd_path_name(), iters, TZ_MAX * 2,
+           (double)g_syscalls / iters, dt * 1e6 / iters);
+}
+
+static void sec_bench(int iters) {
+    puts("== bench: thermal sweep ==");
+    printf("%-9s %6s %6s %10s %10s\n", "backend", "sweeps", "files", "syscalls", "us/sweep");
+
+    g_use_uring = 0;
+    bench_one(iters);
+
+    g_use_uring = 1;
+    if (uring_init() == 0) bench_one(iters);
+    else puts("io_uring  unavailable (kernel < 5.17, seccomp, or disabled)");
+    hr();
+
+    puts("== bench: rolling stats ==");
+    static struct rstat r;
+    rs_init(&r, 0, 100);
+    const int n = 1000000;
+    double t0 = now_s();
+    for (int i = 0; i < n; i++) rs_add(&r, i * 0.1, (i * 37) % 100);
+    double t1 = now_s();
+    struct rs_result res;
+    volatile double sink = 0;
+    for (int i = 0; i < n; i++) {
+        rs_query(&r, i % RS_WIN, (n - 1) * 0.1, &res);
+        sink += res.p99;
+    }
+    double t2 = now_s();
+    printf("update  : %6.1f ns  (%d samples, %zu bytes/metric)\n", (t1 - t0) * 1e9 / n, n, sizeof(r));
+    printf("query   : %6.1f ns  (min/mean/p50/p95/p99/max)\n", (t2 - t1) * 1e9 / n);
+    hr();
+}
+
+// ---- overhead governor ----
+// Budget logic lives in ../common/dsgov.h; droidstat's notes go to stdout
+// with the rest of the report.
+
+static void gov_note(const char *msg) {
+    puts(msg);
+    fflush(stdout);
+}
+
+// Sources shared by the exporter and the sampler.
+static int gs_mem, gs_vm, gs_load, gs_thermal;
+
+static void gov_sources(int with_vmstat) {
+    gs_thermal = gov_add("thermal");
+    gs_mem = gov_add("meminfo");
+    gs_vm = with_vmstat ? gov_add("vmstat") : -1;
+    gs_load = gov_add("loadavg");
+    gov_start(now_s());
+}
+
+// ---- OpenMetrics exporter ----
+// Collection runs on a timerfd and renders the whole HTTP response into one
+// of two static buffers. A scrape is read request headers -> write cached
+// bytes -> close; nothing on that path allocates. A connection pins the buffer it
+// started on, so a refresh never tears a response that is still being sent.
+
+#define EXP_BUF_SZ   65536
+#define EXP_MAX_CONN 64
+#define EXP_HDR_MAX  8192   // request headers past this get a 431
+
+struct exp_buf {
+    char data[EXP_BUF_SZ];
+    size_t len;
+    int users;          // connections still writing from this buffer
+};
+
+struct exp_conn {
+    int fd;             // -1 = free slot
+    struct exp_buf *b;
+    size_t off;
+    size_t hdr_len;     // request bytes read so far
+    int bol;            // last byte ended a header line
+};
+
+static struct exp_buf exp_bufs[2];
+static struct exp_buf exp_431 = {
+    .data = "HTTP/1.0 431 Request Header Fields Too Large\r\n"
+            "Content-Length: 0\r\nConnection: close\r\n\r\n",
+};
+static struct exp_buf *exp_cur;
+static struct exp_conn exp_conns[EXP_MAX_CONN];
+
+struct mbuf {
+    char *p;
+    size_t len, cap;
+};
+
+static void mb_printf(struct mbuf *m, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void mb_printf(struct mbuf *m, const char *fmt, ...) {
+    if (m->len >= m->cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(m->p + m->len, m->cap - m->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) m->len += (size_t)n;
+    if (m->len > m->cap) m->len = m->cap;
+}
+
+static void mb_gauge(struct mbuf *m, const char *name, const char *unit, const char *help) {
+    mb_printf(m, "# TYPE %s gauge\n", name);
+    if (unit) mb_printf(m, "# UNIT %s %s\n", name, unit);
+    mb_printf(m, "# HELP %s %s\n", name, help);
+}
+
+// OpenMetrics label values: escape backslash, quote and newline.
+static void mb_label(struct mbuf *m, const char *v) {
+    for (; *v; v++) {
+        if (*v == '\\' || *v == '"') mb_printf(m, "\\%c", *v);
+        else if (*v == '\n') mb_printf(m, "\\n");
+        else mb_printf(m, "%c", *v);
+    }
+}
+
+static void render_openmetrics(struct mbuf *m, const struct snapshot *s, double collect_s) {
+    if (s->uptime_s >= 0) {
+        mb_gauge(m, "droidstat_uptime_seconds", "seconds", "Time since boot (CLOCK_BOOTTIME).");
+        mb_printf(m, "droidstat_uptime_seconds %.3f\n", s->uptime_s);
+    }
+
+    static const struct { const char *name, *help; size_t off; } mem[] = {
+        { "droidstat_mem_total_bytes",     "MemTotal from /proc/meminfo.",     offsetof(struct snapshot, mem_total) },
+        { "droidstat_mem_free_bytes",      "MemFree from /proc/meminfo.",      offsetof(struct snapshot, mem_free) },
+        { "droidstat_mem_available_bytes", "MemAvailable from /proc/meminfo.", offsetof(struct snapshot, mem_avail) },
+        { "droidstat_mem_cached_bytes",    "Cached from /proc/meminfo.",       offsetof(struct snapshot, mem_cached) },
+    };
+    for (size_t i = 0; i < sizeof(mem) / sizeof(mem[0]); i++) {
+        long long kb = *(const long long *)((const char *)s + mem[i].off);
+        if (kb < 0) continue;
+        mb_gauge(m, mem[i].name, "bytes", mem[i].help);
+        mb_printf(m, "%s %lld\n", mem[i].name, kb * 1024);
+    }
+
+    if (s->load[0] >= 0) {
+        mb_gauge(m, "droidstat_load", NULL, "Load average by window.");
+        mb_printf(m, "droidstat_load{window=\"1m\"} %.2f\n", s->load[0]);
+        mb_printf(m, "droidstat_load{window=\"5m\"} %.2f\n", s->load[1]);
+        mb_printf(m, "droidstat_load{window=\"15m\"} %.2f\n", s->load[2]);
+    }
+    if (s->nr_running >= 0) {
+        mb_gauge(m, "droidstat_tasks_running", NULL, "Runnable tasks from /proc/loadavg.");
+        mb_printf(m, "droidstat_tasks_running %d\n", s->nr_running);
+    }
+    if (s->nr_tasks >= 0) {
+        mb_gauge(m, "droidstat_tasks", NULL, "Total tasks from /proc/loadavg or sysinfo().");
+        mb_printf(m, "droidstat_tasks %d\n", s->nr_tasks);
+    }
 
+    if (s->nzones) {
+        mb_gauge(m, "droidstat_thermal_zone_celsius", "celsius", "Thermal zone temperature.");
+        for (int i = 0; i < s->nzones; i++) {
+            mb_printf(m, "droidstat_thermal_zone_celsius{zone=\"%d\",type=\"", s->zone[i].id);
+            mb_label(m, s->zone[i].type);
+            mb_printf(m, "\"} %.1f\n", s->zone[i].c);
+        }
+    }
+
+    mb_gauge(m, "droidstat_collect_seconds", "seconds", "Wall time of the last collection.");
+    mb_printf(m, "droidstat_collect_seconds %.6f\n", collect_s);
+    mb_printf(m, "# EOF\n");
+}
+
+// Collect and render into whichever buffer no connection is using.
+// If both are pinned by slow clients, keep serving the current one.
+static void exp_refresh(void) {
+    struct exp_buf *b = (exp_cur == &exp_bufs[0]) ? &exp_bufs[1] : &exp_bufs[0];
+    if (b->users) return;
+
+    // Sections the governor has slowed keep their last values between runs;
+    // a tick where none is due keeps serving the current response.
+    static struct snapshot s;
+    static unsigned long tick;
+    int do_mem = gov_due(gs_mem, tick), do_load = gov_due(gs_load, tick), do_th = gov_due(gs_thermal, tick);
+    tick++;
+    if (!do_mem && !do_load && !do_th && exp_cur) return;
+
+    double t0 = now_s();
+    if (do_mem)  { gov_begin(); collect_mem(&s);        gov_end(gs_mem); }
+    if (do_load) { gov_begin(); collect_load(&s);       gov_end(gs_load); }
+    if (do_th)   { gov_begin(); collect_thermal(&s, 0); gov_end(gs_thermal); }
+    double dt = now_s() - t0;
+
+    gov_begin();
+    collect_uptime(&s);
+    static char body[EXP_BUF_SZ - 256];
+    struct mbuf m = { body, 0, sizeof(body) };
+    render_openmetrics(&m, &s, dt);
+
+    int n = snprintf(b->data, sizeof(b->data),
+                     "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", m.len);
+    memcpy(b->data + n, body, m.len);
+    b->len = (size_t)n + m.len;
+    exp_cur = b;
+    gov_end_tick();
+}
+
+static int exp_listen(const char *addr) {
+    int fd;
+    if (!strncmp(addr, "unix:", 5)) {
+        struct sockaddr_un sun = { .sun_family = AF_UNIX };
+        if (strlen(addr + 5) >= sizeof(sun.sun_path)) return -1;
+        strcpy(sun.sun_path, addr + 5);
+        unlink(sun.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) { close(fd); return -1; }
+    } else if (!strncmp(addr, "tcp:", 4)) {
+        // Loopback only: this is a local collector endpoint, not a public service.
+        struct sockaddr_in sin = { .sin_family = AF_INET };
+        sin.sin_port = htons((unsigned short)atoi(addr + 4));
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0) { close(fd); return -1; }
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    if (listen(fd, 128) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+// Unread request bytes would make close() send an RST, which can drop the
+// response the client has not read yet: half-close, then drain first.
+static void conn_close(struct exp_conn *c) {
+    char junk[512];
+    if (c->b) c->b->users--;
+    shutdown(c->fd, SHUT_WR);
+    while (recv(c->fd, junk, sizeof(junk), 0) > 0) {}
+    close(c->fd);
+    c->fd = -1;
+    c->b = NULL;
+}
+
+// Reads until the blank line that ends the headers; the request line and
+// headers are not inspected, since every path is /metrics.
+// Returns 1 = headers complete, 0 = need more, -1 = peer gone.
+static int conn_read_headers(struct exp_conn *c, char *scratch, size_t cap) {
+    for (;;) {
+        ssize_t k = recv(c->fd, scratch, cap, 0);
+        if (k == 0) return -1;
+        if (k < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        for (ssize_t i = 0; i < k; i++) {
+            if (scratch[i] == '\n') {
+                if (c->bol) return 1;
+                c->bol = 1;
+            } else if (scratch[i] != '\r') {
+                c->bol = 0;
+            }
+        }
+        c->hdr_len += (size_t)k;
+        if (c->hdr_len > EXP_HDR_MAX) return 1;
+    }
+}
+
+// Returns 1 when the connection is finished (sent or failed).
+static int conn_write(struct exp_conn *c) {
+    while (c->off < c->b->len) {
+        ssize_t k = send(c->fd, c->b->data + c->off, c->b->len - c->off, MSG_NOSIGNAL);
+        if (k < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : 1;
+        c->off += (size_t)k;
+    }
+    return 1;
+}
+
+static int run_exporter(const char *addr, int interval_s) {
+    int lfd = exp_listen(addr);
+    if (lfd < 0) {
+        fprintf(stderr, "export: cannot listen on %s: %s\n", addr, strerror(errno));
+        fprintf(stderr, "usage : --export unix:/path | --export tcp:PORT\n");
+        return 1;
+    }
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its = { { interval_s, 0 }, { interval_s, 0 } };
+    timerfd_settime(tfd, 0, &its, NULL);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.u64 = ~0ULL;       epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.u64 = ~0ULL - 1;   epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+    ev.data.u64 = ~0ULL - 2;   epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+
+    for (int i = 0; i < EXP_MAX_CONN; i++) exp_conns[i].fd = -1;
+    exp_431.len = strlen(exp_431.data);
+    gov_sources(0);
+    exp_refresh();
+
+    printf("droidstat exporter: %s (refresh every %ds, Ctrl-C to stop)\n", addr, interval_s);
+    fflush(stdout);
+
+    struct epoll_event evs[EXP_MAX_CONN + 3];
+    char scratch[2048];
+    int running = 1;
+
+    while (running) {
+        int n = epoll_wait(ep, evs, (int)(sizeof(evs) / sizeof(evs[0])), -1);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++) {
+            uint64_t id = evs[i].data.u64;
+
+            if (id == ~0ULL) {
+                int cfd;
+                while ((cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    int slot = -1;
+                    for (int k = 0; k < EXP_MAX_CONN; k++) if (exp_conns[k].fd < 0) { slot = k; break; }
+                    if (slot < 0) { close(cfd); continue; }
+                    exp_conns[slot].fd = cfd;
+                    exp_conns[slot].b = NULL;
+                    exp_conns[slot].off = 0;
+                    exp_conns[slot].hdr_len = 0;
+                    exp_conns[slot].bol = 0;
+                    struct epoll_event cev = { .events = EPOLLIN | EPOLLRDHUP };
+                    cev.data.u64 = (uint64_t)slot;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &cev);
+                }
+            } else if (id == ~0ULL - 1) {
+                uint64_t ticks;
+                if (read(tfd, &ticks, sizeof(ticks)) > 0) {
+                    exp_refresh();
+                    gov_check(now_s(), 1.0 / interval_s);
+                }
+            } else if (id == ~0ULL - 2) {
+                running = 0;
+            } else {
+                struct exp_conn *c = &exp_conns[id];
+                if (!c->b) {
+                    int r = conn_read_headers(c, scratch, sizeof(scratch));
+                    if (r < 0) { conn_close(c); continue; }
+                    if (r == 0) continue;
+                    c->b = c->hdr_len > EXP_HDR_MAX ? &exp_431 : exp_cur;
+                    c->b->users++;
+                }
+                if (conn_write(c)) {
+                    conn_close(c);
+                } else {
+                    struct epoll_event cev = { .events = EPOLLOUT };
+                    cev.data.u64 = id;
+                    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &cev);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < EXP_MAX_CONN; i++) if (exp_conns[i].fd >= 0) conn_close(&exp_conns[i]);
+    if (!strncmp(addr, "unix:", 5)) unlink(addr + 5);
+    close(ep); close(sfd); close(tfd); close(lfd);
+    return 0;
+}
+
+// ---- structured snapshot ----
+// One record, one "key value" per line; the value runs to end of line.
+// Records can be appended to the same file. Never spawns su: run the whole
+// thing under su if sysfs is blocked.
+//
+//   droidstat 1
+//   model Pixel 7
+//   release 5.10.157-android13-4-...
+//   uptime_s 12345.67
+//   mem_total_kb 7869612
+//   ...
+//   thermal <zone> <celsius> <type>
+
+static void read_model(char *out, size_t out_sz) {
+    if (run_line("getprop ro.product.model 2>/dev/null", out, out_sz) == 0 && out[0]) return;
+
+    // Linux hosts: DMI product name
+    FILE *fp = fopen("/sys/devices/virtual/dmi/id/product_name", "r");
+    if (!fp) prof_file(0, 0);
+    if (fp) {
+        int ok = fgets(out, (int)out_sz, fp) != NULL;
+        prof_file(ok, (unsigned long)ftell(fp));
+        fclose(fp);
+        trim(out);
+        if (ok && out[0]) return;
+    }
+    snprintf(out, out_sz, "unknown");
+}
+
+static void print_snapshot(void) {
+    struct snapshot s;
+    collect_uptime(&s);
+    collect_mem(&s);
+    collect_load(&s);
+    collect_thermal(&s, 0);
+
+    char model[128];
+    read_model(model, sizeof(model));
+    struct utsname u;
+    if (uname(&u) != 0) snprintf(u.release, sizeof(u.release), "unknown");
+
+    puts("droidstat 1");
+    printf("model %s\n", model);
+    printf("release %s\n", u.release);
+    if (s.uptime_s >= 0)   printf("uptime_s %.2f\n", s.uptime_s);
+    if (s.mem_total >= 0)  printf("mem_total_kb %lld\n", s.mem_total);
+    if (s.mem_free >= 0)   printf("mem_free_kb %lld\n", s.mem_free);
+    if (s.mem_avail >= 0)  printf("mem_avail_kb %lld\n", s.mem_avail);
+    if (s.mem_cached >= 0) printf("mem_cached_kb %lld\n", s.mem_cached);
+    if (s.load[0] >= 0)    printf("load1 %.2f\nload5 %.2f\nload15 %.2f\n", s.load[0], s.load[1], s.load[2]);
+    for (int i = 0; i < s.nzones; i++)
+        printf("thermal %d %.1f %s\n", s.zone[i].id, s.zone[i].c, s.zone[i].type);
+}
+
+// ---- vmstat rates ----
+// Reclaim/fault counters (and meminfo) sampled by slot through kvfile.h,
+// fed to the sampler as per-second rates.
+
+static struct kvfile vm_file, mi_file;
+static int vm_ok, mi_ok;
+
+static void vm_reopen(void) {
+    kv_close(&vm_file);
+    kv_close(&mi_file);
+    vm_ok = kv_open(&vm_file, "/proc/vmstat", vm_slot) == 0;
+    mi_ok = kv_open(&mi_file, "/proc/meminfo", mi_slot) == 0;
+}
+
+// ---- sampling mode ----
+// Samples at a fixed rate into per-metric rolling stats and prints the
+// window tables every report interval. Memory is fixed after startup.
+
+#define SM_VM  (2 + TZ_MAX)        // first vmstat rate slot
+#define SM_MAX (SM_VM + VM_N)
+
+struct metric {
+    char name[64];
+    int used;
+    struct rstat rs;
+};
+
+static struct metric sm[SM_MAX];
+static volatile sig_atomic_t sm_stop = 0;
+
+static void sm_on_signal(int sig) { (void)sig; sm_stop = 1; }
+
+static void sm_print(double t, double hz, unsigned long samples) {
+    printf("== rolling stats (t=+%.0fs, %.1f Hz, %lu samples) ==\n", t, hz, samples);
+    printf("%-24s %-4s %7s %9s %9s %9s %9s %9s %9s\n",
+           "metric", "win", "n", "min", "mean", "p50", "p95", "p99", "max");
+    for (int i = 0; i < SM_MAX; i++) {
+        if (!sm[i].used) continue;
+        for (int w = 0; w < RS_WIN; w++) {
+            struct rs_result r;
+            rs_query(&sm[i].rs, w, t, &r);
+            if (!r.n) continue;
+            printf("%-24.24s %-4s %7u %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+                   w ? "" : sm[i].name, rs_win_name[w], r.n, r.min, r.mean, r.p50, r.p95, r.p99, r.max);
+        }
+    }
+    gov_summary(hz);
+    hr();
+    fflush(stdout);
+}
+
+static void sm_feed(int idx, const char *name, double lo, double hi, double t, double v) {
+    struct metric *m = &sm[idx];
+    if (!m->used) {
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        rs_init(&m->rs, lo, hi);
+        m->used = 1;
+    }
+    rs_add(&m->rs, t, v);
+}
+
+// Latest sample for local consumers (dsshm.h). Publishing is a plain
+// memory write under the seqlock, so it never blocks on readers.
+static struct dsshm *sm_shm;
+
+static void sm_publish(const struct snapshot *s) {
+    static struct dsshm_snap rec;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    rec.sample++;
+    rec.mono_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    rec.uptime_s = s->uptime_s;
+    rec.mem_total_kb = s->mem_total;
+    rec.mem_free_kb = s->mem_free;
+    rec.mem_avail_kb = s->mem_avail;
+    rec.mem_cached_kb = s->mem_cached;
+    for (int i = 0; i < 3; i++) rec.load[i] = s->load[i];
+    rec.nr_running = s->nr_running;
+    rec.nr_tasks = s->nr_tasks;
+    rec.nzones = s->nzones < DSSHM_ZONES ? s->nzones : DSSHM_ZONES;
+    for (int i = 0; i < rec.nzones; i++) {
+        snprintf(rec.zone[i].type, sizeof(rec.zone[i].type), "%s", s->zone[i].type);
+        rec.zone[i].id = s->zone[i].id;
+        rec.zone[i].milli_c = (int32_t)(s->zone[i].c * 1000.0);
+    }
+    dsshm_publish(sm_shm, &rec);
+}
+
+static int run_sampler(double hz, int report_s, int duration_s, const char *publish) {
+    if (hz > 100) hz = 100;
+    long long period_ns = (long long)(1e9 / hz);
+
+    struct snapshot s;
+    collect_mem(&s);
+    double mem_hi = s.mem_total > 0 ? s.mem_total / 1024.0 : 65536;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    double load_hi = 4.0 * (ncpu > 0 ? ncpu : 8);
+
+    char shm_path[256];
+    if (publish) {
+        // Bare names live in /dev/shm; Android has none, so pass a path there.
+        if (strchr(publish, '/')) snprintf(shm_path, sizeof(shm_path), "%s", publish);
+        else snprintf(shm_path, sizeof(shm_path), "/dev/shm/%s", publish);
+        sm_shm = dsshm_create(shm_path);
+        if (!sm_shm) {
+            fprintf(stderr, "publish %s: %s\n", shm_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    signal(SIGINT, sm_on_signal);
+    signal(SIGTERM, sm_on_signal);
+
+    printf("droidstat sampler: %.1f Hz, report every %ds%s\n", hz, report_s,
+           duration_s ? "" : " (Ctrl-C to stop)");
+    if (sm_shm) printf("publishing: %s\n", shm_path);
+    hr();
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double start = next.tv_sec + next.tv_nsec / 1e9, t = 0;
+    double next_report = report_s;
+    unsigned long samples = 0;
+
+    int64_t vm_prev[VM_N], vm_cur[VM_N], mi[MI_N];
+    int have_prev = 0;
+    double vm_t = 0;
+    vm_reopen();
+    gov_sources(1);
+
+    // Sources the governor skips this tick keep last values and feed nothing.
+    for (unsigned long tick = 0; !sm_stop; tick++) {
+        int do_mem = gov_due(gs_mem, tick), do_vm = gov_due(gs_vm, tick);
+        int do_load = gov_due(gs_load, tick), do_th = gov_due(gs_thermal, tick);
+        int vr = -1, mr = -1;
+
+        if (do_vm && vm_ok) { gov_begin(); vr = kv_sample(&vm_file, vm_cur, VM_N); gov_end(gs_vm); }
+        if (do_mem) {
+            gov_begin();
+            if (mi_ok) mr = kv_sample(&mi_file, mi, MI_N);
+            if (mr == 0) {
+                s.mem_total = mi[MI_TOTAL];     // -1 when the kernel lacks the key
+                s.mem_free = mi[MI_FREE];
+                s.mem_avail = mi[MI_AVAIL];
+                s.mem_cached = mi[MI_CACHED];
+            } else {
+                collect_mem(&s);
+            }
+            gov_end(gs_mem);
+        }
+        if (do_load) { gov_begin(); collect_load(&s); gov_end(gs_load); }
+        if (do_th)   { gov_begin(); collect_thermal(&s, 0); gov_end(gs_thermal); }
+        t = now_s() - start;
+        samples++;
+
+        // The rest of the tick only has work when a source ran; that work
+        // is charged to the governor as tick overhead.
+        int ran = do_mem || (do_vm && vm_ok) || do_load || do_th;
+        if (ran) gov_begin();
+
+        if (vr > 0 || mr > 0) { vm_reopen(); have_prev = 0; }     // layout moved
+        if (vr == 0) {
+            for (int i = 0; have_prev && i < VM_N && t > vm_t; i++)
+                if (vm_cur[i] >= 0 && vm_prev[i] >= 0)
+                    sm_feed(SM_VM + i, vm_defs[i].name, 0, vm_defs[i].hi, t,
+                            (double)(vm_cur[i] - vm_prev[i]) / (t - vm_t));
+            memcpy(vm_prev, vm_cur, sizeof(vm_prev));
+            vm_t = t;
+            have_prev = 1;
+        }
+
+        if (sm_shm && ran) {
+            collect_uptime(&s);
+            sm_publish(&s);
+        }
+
+        if (do_mem && s.mem_avail >= 0) sm_feed(0, "mem_avail_mb", 0, mem_hi, t, s.mem_avail / 1024.0);
+        if (do_load && s.load[0] >= 0)  sm_feed(1, "load1", 0, load_hi, t, s.load[0]);
+        for (int i = 0; do_th && i < s.nzones; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "zone%d:%s", s.zone[i].id, s.zone[i].type);
+            sm_feed(2 + s.zone[i].id, name, 0, 128, t, s.zone[i].c);
+        }
+        if (ran) gov_end_tick();
+
+        gov_check(t + start, hz);
+        if (t >= next_report) {
+            sm_print(t, hz, samples);
+            next_report += report_s;
+        }
+        if (duration_s && t >= duration_s) break;
+
+        // Sleep through ticks no source is due on, but wake for the report.
+        unsigned long skip = gov_skip(tick + 1);
+        double until = duration_s && duration_s < next_report ? duration_s : next_report;
+        unsigned long cap = until > t ? (unsigned long)((until - t) * hz) : 0;
+        if (skip > cap) skip = cap;
+        tick += skip;
+        long long ahead = period_ns * (long long)(skip + 1);
+        next.tv_sec += ahead / 1000000000L;
+        next.tv_nsec += ahead % 1000000000L;
+        while (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !sm_stop) {}
+    }
+
+    sm_print(t, hz, samples);
+    return 0;
+}
+
+// ---- dmesg tail / watch ----
+// --watch uses the pattern set and matcher from ../common/dmatch.h.
+
+static int g_watch = 0;     // --watch: tail keeps only matching records
+
+// Keeps the last n records of fp (in watch mode, the last n matching ones)
+// and writes them to out. Returns the bytes read, or -1 on allocation failure.
+static long tail_stream(FILE *fp, int n, FILE *out) {
     char **ring = calloc((size_t)n, sizeof(char *));
-    if (!ring) { pclose(fp); return -1; }
+    if (!ring) return -1;
 
-    char buf[1024];
+    char buf[1024], names[256];
     int idx = 0, count = 0;
+    long bytes = 0;
 
     while (fgets(buf, sizeof(buf), fp)) {
+        size_t len = strlen(buf);
+        bytes += (long)len;
+        // A miss must leave the ring alone: the slot still holds an older match.
+        if (g_watch && !am_match_line(buf, len, names, sizeof(names))) continue;
         free(ring[idx]);
-        ring[idx] = strdup(buf);
+        if (g_watch) {
+            if (asprintf(&ring[idx], "[%s] %s", names, buf) < 0) ring[idx] = NULL;
+        } else {
+            ring[idx] = strdup(buf);
+        }
         if (!ring[idx]) break;
         idx = (idx + 1) % n;
         if (count < n) count++;
     }
-    pclose(fp);
-
-    if (count == 0) {
-        for (int i = 0; i < n; i++) free(ring[i]);
-        free(ring);
-        return -1;
-    }
 
     int start = (count == n) ? idx : 0;
     for (int i = 0; i < count; i++) {
         int pos = (start + i) % n;
-        if (ring[pos]) fputs(ring[pos], stdout);
+        if (ring[pos]) fputs(ring[pos], out);
     }
 
     for (int i = 0; i < n; i++) free(ring[i]);
     free(ring);
-    return 0;
+    return bytes;
+}
+
+static int tail_cmd(const char *cmd, int n) {
+    FILE *fp = popen(cmd, "r");
+    if (!fp) { prof_spawn(0, 0); return -1; }
+    long bytes = tail_stream(fp, n, stdout);
+    pclose(fp);
+    prof_spawn(bytes > 0, bytes > 0 ? (unsigned long)bytes : 0);
+    return bytes > 0 ? 0 : -1;
+}
+
+// ---- self-test ----
+// --selftest runs the dmesg tail on canned input and compares the output.
+
+struct tail_case {
+    const char *label;
+    int watch, n;
+    const char *in, *want;
+};
+
+static const struct tail_case tail_cases[] = {
+    { "tail wraps", 0, 2, "a\nb\nc\n", "b\nc\n" },
+    { "watch keeps matches past noise", 1, 3,
+      "<6> boot\n"
+      "<3> Out of memory: Killed process 1 (a)\n"
+      "<6> noise 1\n"
+      "<3> Out of memory: Killed process 2 (b)\n"
+      "<6> noise 2\n<6> noise 3\n"
+      "<3> Out of memory: Killed process 3 (c)\n"
+      "<6> noise 4\n"
+      "<3> Out of memory: Killed process 4 (d)\n"
+      "<6> noise 5\n<6> noise 6\n",
+      "[oom] <3> Out of memory: Killed process 2 (b)\n"
+      "[oom] <3> Out of memory: Killed process 3 (c)\n"
+      "[oom] <3> Out of memory: Killed process 4 (d)\n" },
+    { "watch with fewer matches than n", 1, 3,
+      "<6> noise\n<3> EXT4-fs error (device sda1)\n<6> noise\n",
+      "[ext4_error] <3> EXT4-fs error (device sda1)\n" },
+    { "watch with several patterns on one line", 1, 2,
+      "x I/O error; Kernel panic\n<6> noise\n",
+      "[io_error,panic] x I/O error; Kernel panic\n" },
+};
+
+static int run_selftest(void) {
+    if (load_patterns(NULL) != 0 || am_build() != 0) { perror("selftest"); return 1; }
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tail_cases) / sizeof(tail_cases[0]); i++) {
+        const struct tail_case *c = &tail_cases[i];
+        char *got = NULL;
+        size_t got_n = 0;
+        FILE *in = fmemopen((void *)c->in, strlen(c->in), "r");
+        FILE *out = open_memstream(&got, &got_n);
+        if (!in || !out) { perror("selftest"); return 1; }
+        g_watch = c->watch;
+        tail_stream(in, c->n, out);
+        fclose(in);
+        fclose(out);
+        int ok = !strcmp(got, c->want);
+        printf("%-4s %s\n", ok ? "ok" : "FAIL", c->label);
+        if (!ok) printf("--- want\n%s--- got\n%s", c->want, got);
+        failed += !ok;
+        free(got);
+    }
+    g_watch = 0;
+    return failed ? 1 : 0;
+}
+
+static void print_watch_counts(void) {
+    unsigned long total = 0;
+    for (int i = 0; i < npats; i++) total += pats[i].matched;
+    if (!total) { puts("no matching records"); return; }
+
+    printf("\n%-16s %8s\n", "pattern", "matched");
+    for (int i = 0; i < npats; i++) {
+        if (pats[i].first != i) continue;   // same name on several literals: report once, summed
+        unsigned long m = 0;
+        for (int j = i; j < npats; j++) if (pats[j].first == i) m += pats[j].matched;
+        if (m) printf("%-16s %8lu\n", pats[i].name, m);
+    }
 }
 
 static void sec_dmesg_tail(int n) {
-    puts("== dmesg tail ==");
-    printf("lines: %d\n\n", n);
+    puts(g_watch ? "== dmesg watch ==" : "== dmesg tail ==");
+    printf(g_watch ? "lines: last %d matching (%d patterns)\n\n" : "lines: %d\n\n", n, npats);
 
-    if (tail_cmd("dmesg 2>/dev/null", n) == 0) { hr(); return; }
+    if (tail_cmd("dmesg 2>/dev/null", n) == 0) {
+        if (g_watch) print_watch_counts();
+        hr();
+        return;
+    }
     if (tail_cmd("su -c dmesg 2>/dev/null", n) == 0) {
+        if (g_watch) print_watch_counts();
         puts("\n(note: used su -c dmesg)");
         hr();
         return;
@@ -198,6 +1334,16 @@ static void sec_dmesg_tail(int n) {
 int main(int argc, char **argv) {
     int want_dmesg = 0;
     int dmesg_n = 30;
+    int bench_n = 0;
+    const char *export_addr = NULL;
+    int want_snapshot = 0;
+    int interval_s = 5;
+    double sample_hz = 0;
+    int report_s = 60;
+    int duration_s = 0;
+    const char *publish = NULL;
+    const char *watch_file = NULL;
+    int sched_idle = 0, pin_cpu = -1;
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--dmesg")) {
@@ -205,18 +1351,98 @@ int main(int argc, char **argv) {
             if (i + 1 < argc) dmesg_n = atoi(argv[i + 1]);
             if (dmesg_n <= 0) dmesg_n = 30;
             if (dmesg_n > 200) dmesg_n = 200;
+        } else if (!strcmp(argv[i], "--watch")) {
+            want_dmesg = g_watch = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') watch_file = argv[++i];
+        } else if (!strcmp(argv[i], "--uring")) {
+            g_use_uring = 1;
+        } else if (!strcmp(argv[i], "--bench")) {
+            bench_n = 100;
+            if (i + 1 < argc) bench_n = atoi(argv[i + 1]);
+            if (bench_n <= 0) bench_n = 100;
+        } else if (!strcmp(argv[i], "--export")) {
+            if (i + 1 < argc) export_addr = argv[++i];
+        } else if (!strcmp(argv[i], "--self-profile")) {
+            g_profile = 1;
+        } else if (!strcmp(argv[i], "--self-profile=json")) {
+            g_profile = 2;
+        } else if (!strcmp(argv[i], "--selftest")) {
+            return run_selftest();
+        } else if (!strcmp(argv[i], "--snapshot")) {
+            want_snapshot = 1;
+        } else if (!strcmp(argv[i], "--sample")) {
+            sample_hz = 10;
+            if (i + 1 < argc && atof(argv[i + 1]) > 0) sample_hz = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--report")) {
+            if (i + 1 < argc) report_s = atoi(argv[++i]);
+            if (report_s <= 0) report_s = 60;
+        } else if (!strcmp(argv[i], "--duration")) {
+            if (i + 1 < argc) duration_s = atoi(argv[++i]);
+            if (duration_s < 0) duration_s = 0;
+        } else if (!strcmp(argv[i], "--publish")) {
+            publish = DSSHM_DEFAULT_PATH;
+            if (i + 1 < argc && argv[i + 1][0] != '-') publish = argv[++i];
+        } else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            gov.budget = atof(argv[++i]) / 100.0;      // "0.5" or "0.5%"
+            if (gov.budget < 0) gov.budget = 0;
+        } else if (!strcmp(argv[i], "--budget-io") && i + 1 < argc) {
+            gov.io_budget = atof(argv[++i]) * 1024.0;  // KB/s
+            if (gov.io_budget < 0) gov.io_budget = 0;
+        } else if (!strcmp(argv[i], "--idle")) {
+            sched_idle = 1;
+        } else if (!strcmp(argv[i], "--cpu") && i + 1 < argc) {
+            pin_cpu = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--interval")) {
+            if (i + 1 < argc) interval_s = atoi(argv[++i]);
+            if (interval_s <= 0) interval_s = 5;
         }
     }
 
+    if (want_snapshot) {
+        if (g_use_uring && uring_init() != 0) g_use_uring = 0;
+        print_snapshot();
+        return 0;
+    }
+
+    if (export_addr) {
+        if (g_use_uring && uring_init() != 0) g_use_uring = 0;
+        gov_sched(sched_idle, pin_cpu);
+        return run_exporter(export_addr, interval_s);
+    }
+
+    if (publish && sample_hz <= 0) sample_hz = 10;
+    if (sample_hz > 0) {
+        if (g_use_uring && uring_init() != 0) g_use_uring = 0;
+        gov_sched(sched_idle, pin_cpu);
+        return run_sampler(sample_hz, report_s, duration_s, publish);
+    }
+
+    if (bench_n) {
+        sec_bench(bench_n);
+        return 0;
+    }
+
+    if (g_watch && (load_patterns(watch_file) != 0 || am_build() != 0)) {
+        perror(watch_file ? watch_file : "watch");
+        return 1;
+    }
+
     puts("droidstat - compact system report (read-only)");
+    if (g_use_uring && uring_init() != 0) {
+        puts("note: io_uring unavailable; using sync reads");
+        g_use_uring = 0;
+    }
     hr();
 
-    sec_uname();
-    sec_uptime();
-    sec_mem();
-    sec_thermal();
-    if (want_dmesg) sec_dmesg_tail(dmesg_n);
+    if (g_profile) prof_init();
+
+    prof_begin("uname");   sec_uname();   prof_end();
+    prof_begin("uptime");  sec_uptime();  prof_end();
+    prof_begin("mem");     sec_mem();     prof_end();
+    prof_begin("thermal"); sec_thermal(); prof_end();
+    if (want_dmesg) { prof_begin("dmesg"); sec_dmesg_tail(dmesg_n); prof_end(); }
 
+    if (g_profile) prof_report();
     puts("done.");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+// dsshm.h - Shared-memory snapshot published by `droidstat --sample --publish`
+// Header-only: droidstat includes it to publish, consumers include it to read.
+//
+// One writer, any number of readers, guarded by a seqlock:
+//   writer: seq -> odd, write record, seq -> even   (never waits: wait-free)
+//   reader: seq (even) -> copy -> seq again; retry if it moved, up to a cap
+// Readers map the file read-only and never make a syscall or take a lock.
+// Record words are copied with relaxed atomics so the overlap with a
+// concurrent write is a benign retry, not a C data race.
+//
+// Reader example:
+//   struct dsshm *m = dsshm_open(DSSHM_DEFAULT_PATH);
+//   struct dsshm_snap s;
+//   if (m && dsshm_read(m, &s) >= 0) printf("%lld kB avail\n", (long long)s.mem_avail_kb);
+
+#ifndef DSSHM_H
+#define DSSHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DSSHM_MAGIC         0x48535344u     // "DSSH"
+#define DSSHM_VERSION       1
+#define DSSHM_ZONES         32
+#define DSSHM_DEFAULT_PATH  "/dev/shm/droidstat"
+#define DSSHM_WAIT_NS       20000000        // reader gives up after 20 ms without a clean copy
+
+// dsshm_read() results below zero.
+#define DSSHM_EMPTY         (-1)            // nothing published yet
+#define DSSHM_BUSY          (-2)            // seq never settled: writer stuck or killed mid-update
+
+struct dsshm_zone {
+    char type[24];
+    int32_t id;
+    int32_t milli_c;
+};
+
+// All fields are 8-byte multiples so the record copies as 64-bit words.
+struct dsshm_snap {
+    uint64_t sample;                // increments per publish
+    int64_t mono_ns;                // CLOCK_MONOTONIC at collection
+    double uptime_s;
+    int64_t mem_total_kb, mem_free_kb, mem_avail_kb, mem_cached_kb;     // -1 = unknown
+    double load[3];                 // -1 = unknown
+    int32_t nr_running, nr_tasks;
+    int32_t nzones, pad;
+    struct dsshm_zone zone[DSSHM_ZONES];
+};
+
+struct dsshm {
+    uint32_t magic, version, size, pad;
+    uint32_t seq;                   // odd while the writer is mid-update
+    char pad2[64 - 5 * sizeof(uint32_t)];   // keep seq and the record off the header line
+    struct dsshm_snap snap;
+};
+
+_Static_assert(sizeof(struct dsshm_snap) % 8 == 0, "dsshm_snap must copy as whole words");
+
+// ---- writer ----
+
+// Reopening an existing segment keeps its seq: a reader still mapped to it
+// may hold an old even value, and going back to it would let that reader
+// accept a torn copy. A fresh file starts zero-filled.
+static inline struct dsshm *dsshm_create(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(struct dsshm)) != 0) { close(fd); return NULL; }
+    void *p = mmap(NULL, sizeof(struct dsshm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    struct dsshm *m = p;
+    if (__atomic_load_n(&m->magic, __ATOMIC_RELAXED) != DSSHM_MAGIC)
+        __atomic_store_n(&m->seq, 0, __ATOMIC_RELAXED);     // not ours: no reader can have mapped it
+    m->version = DSSHM_VERSION;
+    m->size = sizeof(struct dsshm);
+    __atomic_store_n(&m->magic, DSSHM_MAGIC, __ATOMIC_RELEASE);
+    return m;
+}
+
+static inline void dsshm_publish(struct dsshm *m, const struct dsshm_snap *s) {
+    // seq is already odd if a previous writer died mid-update; stay odd.
+    uint32_t q = __atomic_load_n(&m->seq, __ATOMIC_RELAXED) | 1;
+    __atomic_store_n(&m->seq, q, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);        // odd seq is visible before any data word
+
+    const uint64_t *src = (const uint64_t *)s;
+    uint64_t *dst = (uint64_t *)&m->snap;
+    for (size_t i = 0; i < sizeof(*s) / 8; i++) __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&m->seq, q + 1, __ATOMIC_RELEASE);
+}
+
+// ---- reader ----
+
+static inline struct dsshm *dsshm_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;     // a short file would SIGBUS on access, not fail here
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct dsshm)) { close(fd); return NULL; }
+    void *p = mmap(NULL, sizeof(struct dsshm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    struct dsshm *m = p;
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != DSSHM_MAGIC ||
+        m->version != DSSHM_VERSION || m->size != sizeof(struct dsshm)) {
+        munmap(p, sizeof(struct dsshm));
+        return NULL;
+    }
+    return m;
+}
+
+// Copies a consistent record. Returns how many copies were discarded (>= 0),
+// DSSHM_EMPTY if nothing has been published yet, or DSSHM_BUSY if seq stayed
+// odd or kept moving for DSSHM_WAIT_NS (a dead writer leaves it odd). The
+// clock is only read every 4096 attempts; on the fast path it is never read.
+static inline int dsshm_read(const struct dsshm *m, struct dsshm_snap *out) {
+    const uint64_t *src = (const uint64_t *)&m->snap;
+    uint64_t *dst = (uint64_t *)out;
+    int retries = 0;
+    int64_t t0 = 0;
+    for (unsigned long tries = 1; ; tries++) {
+        if (tries % 4096 == 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            if (!t0) t0 = now;
+            else if (now - t0 > DSSHM_WAIT_NS) return DSSHM_BUSY;
+        }
+        uint32_t s0 = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+        if (s0 == 0) return DSSHM_EMPTY;
+        if (s0 & 1) continue;                       // writer mid-update
+
+        for (size_t i = 0; i < sizeof(*out) / 8; i++) dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);    // data loads complete before the re-check
+        if (__atomic_load_n(&m->seq, __ATOMIC_RELAXED) == s0) return retries;
+        retries++;
+    }
+}
+
+static inline void dsshm_close(struct dsshm *m) {
+    if (m) munmap(m, sizeof(struct dsshm));
+}
+
+#endif
@@ -0,0 +1,516 @@
+// fleetagg.c - Merge many `droidstat --snapshot` files into fleet-wide percentiles
+// Each worker thread parses a share of the files into its own fixed-size
+// histograms; the per-thread tables are merged bucket-by-bucket at the end.
+//
+// Build: clang -std=c11 -Wall -Wextra -O2 -pthread fleetagg.c -o fleetagg -lm
+// Run  : ./fleetagg snaps/                    (directory of snapshot files)
+//        ./fleetagg --by release -j 8 a.txt b.txt snaps/
+//        find snaps -type f | ./fleetagg -      (file list on stdin)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// ---- mergeable log-linear histogram ----
+// 64 sub-buckets per power of two over |v| in [2^-7, 2^25): ~1% relative
+// error, fixed 16 KB per histogram. Negative values get a mirrored set of
+// buckets below a zero bucket, which takes |v| < 2^-7, so bucket order is
+// value order and quantiles keep their sign. Exact min/max are kept on the
+// side; NaN is not counted.
+
+#define H_SUB    64
+#define H_MINEXP (-7)
+#define H_OCT    32
+#define H_ZERO   (H_SUB * H_OCT)        // index of the zero bucket
+#define H_BINS   (2 * H_ZERO + 1)
+
+struct hist {
+    uint32_t bin[H_BINS];
+    uint64_t n;
+    double min, max;
+};
+
+static int h_index(double v) {
+    int e;
+    double m = frexp(fabs(v), &e);      // |v| = m * 2^e, m in [0.5, 1)
+    int oct = e - 1 - H_MINEXP;
+    if (v == 0 || oct < 0) return H_ZERO;
+    int mag = oct >= H_OCT ? H_ZERO - 1 : oct * H_SUB + (int)((2.0 * m - 1.0) * H_SUB);
+    return v > 0 ? H_ZERO + 1 + mag : H_ZERO - 1 - mag;
+}
+
+static double h_value(int idx) {
+    if (idx == H_ZERO) return 0;
+    int mag = idx > H_ZERO ? idx - H_ZERO - 1 : H_ZERO - 1 - idx;
+    int oct = mag / H_SUB, sub = mag % H_SUB;
+    double v = ldexp(1.0 + (sub + 0.5) / H_SUB, oct + H_MINEXP);
+    return idx > H_ZERO ? v : -v;
+}
+
+static void h_add(struct hist *h, double v) {
+    if (isnan(v)) return;
+    h->bin[h_index(v)]++;
+    if (!h->n || v < h->min) h->min = v;
+    if (!h->n || v > h->max) h->max = v;
+    h->n++;
+}
+
+static void h_merge(struct hist *dst, const struct hist *src) {
+    if (!src->n) return;
+    for (int i = 0; i < H_BINS; i++) dst->bin[i] += src->bin[i];
+    if (!dst->n || src->min < dst->min) dst->min = src->min;
+    if (!dst->n || src->max > dst->max) dst->max = src->max;
+    dst->n += src->n;
+}
+
+static double h_quantile(const struct hist *h, double q) {
+    uint64_t rank = (uint64_t)(q * (double)(h->n - 1)) + 1, seen = 0;
+    for (int i = 0; i < H_BINS; i++) {
+        seen += h->bin[i];
+        if (seen >= rank) {
+            double v = h_value(i);
+            if (v < h->min) v = h->min;
+            if (v > h->max) v = h->max;
+            return v;
+        }
+    }
+    return h->max;
+}
+
+// ---- groups ----
+// A group is one value of the --by key (model or kernel release). Metric
+// slots 0..M_FIXED-1 are fixed; thermal zone types get slots after that.
+
+enum { M_MEM_AVAIL_PCT, M_LOAD1, M_UPTIME_H, M_FIXED };
+
+static const char *fixed_names[M_FIXED] = { "mem_avail_pct", "load1", "uptime_h" };
+
+#define KEY_MAX   96
+#define TYPE_MAX  64
+#define GROUP_CAP 1024          // hash slots per table (power of two)
+
+struct group {
+    char key[KEY_MAX];          // "" = empty slot
+    uint64_t snapshots;
+    struct hist *m[M_FIXED + TYPE_MAX];
+};
+
+struct table {
+    struct group g[GROUP_CAP];
+    int ngroups;
+    char types[TYPE_MAX][48];   // thermal zone type per slot (M_FIXED + i)
+    int ntypes;
+    uint64_t files, records, bad, errors;
+};
+
+static uint32_t fnv1a(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static struct group *group_get(struct table *t, const char *key) {
+    uint32_t i = fnv1a(key) & (GROUP_CAP - 1);
+    for (int probe = 0; probe < GROUP_CAP; probe++, i = (i + 1) & (GROUP_CAP - 1)) {
+        struct group *g = &t->g[i];
+        if (!g->key[0]) {
+            snprintf(g->key, sizeof(g->key), "%s", key);
+            t->ngroups++;
+            return g;
+        }
+        if (!strcmp(g->key, key)) return g;
+    }
+    return NULL;                // table full
+}
+
+static int type_slot(struct table *t, const char *type) {
+    for (int i = 0; i < t->ntypes; i++)
+        if (!strcmp(t->types[i], type)) return M_FIXED + i;
+    if (t->ntypes == TYPE_MAX) return -1;
+    snprintf(t->types[t->ntypes], sizeof(t->types[0]), "%s", type);
+    return M_FIXED + t->ntypes++;
+}
+
+static void group_add(struct group *g, int slot, double v) {
+    if (slot < 0) return;
+    if (!g->m[slot]) {
+        g->m[slot] = calloc(1, sizeof(struct hist));
+        if (!g->m[slot]) return;
+    }
+    h_add(g->m[slot], v);
+}
+
+// ---- snapshot parser ----
+
+enum { BY_MODEL, BY_RELEASE };
+
+struct record {
+    char model[KEY_MAX], release[KEY_MAX];
+    double uptime_s, load1;
+    long long mem_total, mem_avail;
+    int nzones;
+    double zone_c[TYPE_MAX];
+    char zone_type[TYPE_MAX][48];
+};
+
+static void record_reset(struct record *r) {
+    snprintf(r->model, sizeof(r->model), "unknown");
+    snprintf(r->release, sizeof(r->release), "unknown");
+    r->uptime_s = r->load1 = -1;
+    r->mem_total = r->mem_avail = -1;
+    r->nzones = 0;
+}
+
+static void record_flush(struct table *t, struct record *r, int by) {
+    struct group *g = group_get(t, by == BY_MODEL ? r->model : r->release);
+    if (!g) { t->bad++; return; }
+
+    g->snapshots++;
+    t->records++;
+    if (r->mem_total > 0 && r->mem_avail >= 0)
+        group_add(g, M_MEM_AVAIL_PCT, (double)r->mem_avail * 100.0 / (double)r->mem_total);
+    if (r->load1 >= 0) group_add(g, M_LOAD1, r->load1);
+    if (r->uptime_s >= 0) group_add(g, M_UPTIME_H, r->uptime_s / 3600.0);
+    for (int i = 0; i < r->nzones; i++)
+        group_add(g, type_slot(t, r->zone_type[i]), r->zone_c[i]);
+}
+
+static void copy_rest(char *dst, size_t dst_sz, const char *v, const char *end) {
+    size_t n = (size_t)(end - v);
+    if (n >= dst_sz) n = dst_sz - 1;
+    memcpy(dst, v, n);
+    dst[n] = '\0';
+}
+
+// Parses the lines in buf[0..len); every line but an end-of-file tail ends
+// in '\n', and buf[len] is readable. *in_record carries the open record
+// across calls, so a file can be fed in chunks.
+static void parse_lines(struct table *t, struct record *r, int *in_record, char *buf, size_t len, int by) {
+    char *p = buf, *end = buf + len;
+
+    while (p < end) {
+        char *nl = memchr(p, '\n', (size_t)(end - p));
+        char *eol = nl ? nl : end;
+        char *sp = memchr(p, ' ', (size_t)(eol - p));
+
+        if (sp) {
+            size_t klen = (size_t)(sp - p);
+            const char *v = sp + 1;
+
+            if (klen == 9 && !memcmp(p, "droidstat", 9)) {
+                if (*in_record) record_flush(t, r, by);
+                record_reset(r);
+                *in_record = 1;
+            } else if (!*in_record) {
+                // garbage before the header: skip
+            } else if (klen == 5 && !memcmp(p, "model", 5)) {
+                copy_rest(r->model, sizeof(r->model), v, eol);
+            } else if (klen == 7 && !memcmp(p, "release", 7)) {
+                copy_rest(r->release, sizeof(r->release), v, eol);
+            } else if (klen == 8 && !memcmp(p, "uptime_s", 8)) {
+                r->uptime_s = strtod(v, NULL);
+            } else if (klen == 12 && !memcmp(p, "mem_total_kb", 12)) {
+                r->mem_total = strtoll(v, NULL, 10);
+            } else if (klen == 12 && !memcmp(p, "mem_avail_kb", 12)) {
+                r->mem_avail = strtoll(v, NULL, 10);
+            } else if (klen == 5 && !memcmp(p, "load1", 5)) {
+                r->load1 = strtod(v, NULL);
+            } else if (klen == 7 && !memcmp(p, "thermal", 7) && r->nzones < TYPE_MAX) {
+                // thermal <zone> <celsius> <type>
+                char *q;
+                strtol(v, &q, 10);
+                double c = strtod(q, &q);
+                while (q < eol && *q == ' ') q++;
+                if (q < eol) {
+                    r->zone_c[r->nzones] = c;
+                    copy_rest(r->zone_type[r->nzones], sizeof(r->zone_type[0]), q, eol);
+                    r->nzones++;
+                }
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+// ---- workers ----
+
+struct job {
+    char **files;
+    int nfiles;
+    int next;                   // atomic cursor
+    int by;
+};
+
+struct worker {
+    pthread_t th;
+    struct job *job;
+    struct table *t;
+};
+
+#define CHUNK (1 << 20)
+
+// Streams one file through the parser in CHUNK reads; the partial line at
+// the end of a read moves to the front of the buffer for the next one, so
+// appended snapshot files of any size are read whole. A line longer than
+// CHUNK is dropped up to its '\n' and counted as bad. On a read error the
+// open record is dropped and the caller counts the file.
+static int parse_file(struct table *t, struct record *r, char *buf, const char *path, int by) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    int in_record = 0, skip = 0;
+    size_t have = 0;
+    ssize_t k;
+    for (;;) {
+        k = read(fd, buf + have, CHUNK - have);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) break;
+        have += (size_t)k;
+
+        if (skip) {
+            char *nl = memchr(buf, '\n', have);
+            if (!nl) { have = 0; continue; }
+            size_t cut = (size_t)(nl + 1 - buf);
+            memmove(buf, buf + cut, have - cut);
+            have -= cut;
+            skip = 0;
+        }
+        buf[have] = '\0';
+
+        char *nl = memrchr(buf, '\n', have);
+        if (!nl) {
+            if (have < CHUNK) continue;
+            t->bad++;
+            skip = 1;
+            have = 0;
+            continue;
+        }
+        size_t done = (size_t)(nl + 1 - buf);
+        parse_lines(t, r, &in_record, buf, done, by);
+        memmove(buf, buf + done, have - done);
+        have -= done;
+    }
+    int err = k < 0 ? errno : 0;
+    close(fd);
+    if (err) { errno = err; return -1; }
+
+    buf[have] = '\0';
+    if (have) parse_lines(t, r, &in_record, buf, have, by);
+    if (in_record) record_flush(t, r, by);
+    else t->bad++;
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct job *job = w->job;
+    struct record *r = malloc(sizeof(*r));
+    char *buf = malloc(CHUNK + 1);
+    if (!r || !buf) { free(r); free(buf); return NULL; }
+
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->nfiles) break;
+
+        if (parse_file(w->t, r, buf, job->files[i], job->by) != 0) {
+            fprintf(stderr, "%s: %s\n", job->files[i], strerror(errno));
+            w->t->bad++;
+            w->t->errors++;
+            continue;
+        }
+        w->t->files++;
+    }
+    free(buf);
+    free(r);
+    return NULL;
+}
+
+static void table_merge(struct table *dst, const struct table *src) {
+    dst->files += src->files;
+    dst->records += src->records;
+    dst->bad += src->bad;
+    dst->errors += src->errors;
+
+    for (int i = 0; i < GROUP_CAP; i++) {
+        const struct group *sg = &src->g[i];
+        if (!sg->key[0]) continue;
+        struct group *dg = group_get(dst, sg->key);
+        if (!dg) { dst->bad += sg->snapshots; continue; }
+        dg->snapshots += sg->snapshots;
+
+        for (int m = 0; m < M_FIXED + TYPE_MAX; m++) {
+            if (!sg->m[m]) continue;
+            int slot = (m < M_FIXED) ? m : type_slot(dst, src->types[m - M_FIXED]);
+            if (slot < 0) continue;
+            if (!dg->m[slot]) {
+                dg->m[slot] = calloc(1, sizeof(struct hist));
+                if (!dg->m[slot]) continue;
+            }
+            h_merge(dg->m[slot], sg->m[m]);
+        }
+    }
+}
+
+static void table_free(struct table *t) {
+    for (int i = 0; i < GROUP_CAP; i++)
+        for (int m = 0; m < M_FIXED + TYPE_MAX; m++) free(t->g[i].m[m]);
+    free(t);
+}
+
+// ---- input list ----
+
+struct list {
+    char **v;
+    int n, cap;
+};
+
+static void list_add(struct list *l, const char *s) {
+    if (l->n == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 1024;
+        char **nv = realloc(l->v, (size_t)cap * sizeof(char *));
+        if (!nv) return;
+        l->v = nv;
+        l->cap = cap;
+    }
+    char *d = strdup(s);
+    if (d) l->v[l->n++] = d;
+}
+
+static void add_path(struct list *l, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) { fprintf(stderr, "skip %s: %s\n", path, strerror(errno)); return; }
+    if (!S_ISDIR(st.st_mode)) { list_add(l, path); return; }
+
+    DIR *d = opendir(path);
+    if (!d) { fprintf(stderr, "skip %s: %s\n", path, strerror(errno)); return; }
+    struct dirent *e;
+    char full[4096];
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        if (e->d_type != DT_REG && e->d_type != DT_UNKNOWN) continue;
+        snprintf(full, sizeof(full), "%s/%s", path, e->d_name);
+        list_add(l, full);
+    }
+    closedir(d);
+}
+
+static int cmp_group(const void *a, const void *b) {
+    const struct group *x = *(const struct group *const *)a, *y = *(const struct group *const *)b;
+    if (x->snapshots != y->snapshots) return x->snapshots < y->snapshots ? 1 : -1;
+    return strcmp(x->key, y->key);
+}
+
+static void print_row(const char *name, const struct hist *h) {
+    printf("%-24.24s %8llu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", name,
+           (unsigned long long)h->n, h->min, h_quantile(h, 0.50), h_quantile(h, 0.90),
+           h_quantile(h, 0.95), h_quantile(h, 0.99), h->max);
+}
+
+static void print_table(const struct table *t, int by) {
+    const struct group **gs = malloc((size_t)t->ngroups * sizeof(*gs));
+    if (!gs) return;
+    int n = 0;
+    for (int i = 0; i < GROUP_CAP; i++) if (t->g[i].key[0]) gs[n++] = &t->g[i];
+    qsort(gs, (size_t)n, sizeof(*gs), cmp_group);
+
+    for (int i = 0; i < n; i++) {
+        const struct group *g = gs[i];
+        printf("== %s: %s (%llu snapshots) ==\n", by == BY_MODEL ? "model" : "release",
+               g->key, (unsigned long long)g->snapshots);
+        printf("%-24s %8s %8s %8s %8s %8s %8s %8s\n",
+               "metric", "n", "min", "p50", "p90", "p95", "p99", "max");
+        for (int m = 0; m < M_FIXED; m++)
+            if (g->m[m]) print_row(fixed_names[m], g->m[m]);
+        for (int m = M_FIXED; m < M_FIXED + t->ntypes; m++) {
+            if (!g->m[m]) continue;
+            char name[64];
+            snprintf(name, sizeof(name), "temp:%s", t->types[m - M_FIXED]);
+            print_row(name, g->m[m]);
+        }
+        puts("");
+    }
+    free(gs);
+}
+
+int main(int argc, char **argv) {
+    int by = BY_MODEL;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct list files = {0};
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--by") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "model")) by = BY_MODEL;
+            else if (!strcmp(argv[i], "release")) by = BY_RELEASE;
+            else { fprintf(stderr, "--by: expected model or release\n"); return 1; }
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            nthreads = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-")) {
+            char line[4096];
+            while (fgets(line, sizeof(line), stdin)) {
+                size_t n = strlen(line);
+                if (n && line[n - 1] == '\n') line[n - 1] = '\0';
+                if (line[0]) list_add(&files, line);
+            }
+        } else {
+            add_path(&files, argv[i]);
+        }
+    }
+    if (nthreads <= 0) nthreads = 1;
+    if (nthreads > 256) nthreads = 256;
+
+    if (files.n == 0) {
+        fprintf(stderr, "usage: %s [--by model|release] [-j N] <file|dir|->...\n", argv[0]);
+        return 1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    struct job job = { files.v, files.n, 0, by };
+    struct worker *ws = calloc((size_t)nthreads, sizeof(*ws));
+    if (!ws) { perror("calloc"); return 1; }
+
+    int started = 0;
+    for (long i = 0; i < nthreads; i++) {
+        ws[i].job = &job;
+        ws[i].t = calloc(1, sizeof(struct table));
+        if (!ws[i].t) break;
+        if (pthread_create(&ws[i].th, NULL, worker_main, &ws[i]) != 0) { free(ws[i].t); break; }
+        started++;
+    }
+    if (!started) { fputs("failed to start workers\n", stderr); return 1; }
+
+    for (int i = 0; i < started; i++) pthread_join(ws[i].th, NULL);
+    for (int i = 1; i < started; i++) {
+        table_merge(ws[0].t, ws[i].t);
+        table_free(ws[i].t);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    struct table *t = ws[0].t;
+    printf("fleetagg: %llu files, %llu snapshots, %d groups, %d threads, %.3fs\n",
+           (unsigned long long)t->files, (unsigned long long)t->records, t->ngroups, started, dt);
+    if (t->bad) printf("note: %llu unreadable files or records skipped\n", (unsigned long long)t->bad);
+    int rc = t->errors ? 1 : 0;
+    puts("");
+    print_table(t, by);
+
+    table_free(t);
+    free(ws);
+    for (int i = 0; i < files.n; i++) free(files.v[i]);
+    free(files.v);
+    return rc;
+}
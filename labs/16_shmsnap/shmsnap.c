@@ -0,0 +1,200 @@
+// shmsnap.c - Read droidstat's published snapshot from shared memory (no syscalls per read)
+// Consumer side of ../13_droidstat/dsshm.h: start the publisher with
+//   ./droidstat --sample 2 --publish droidstat
+// and any number of readers can map it and copy a consistent record.
+//
+// Build: clang -std=c11 -Wall -Wextra -O2 -pthread shmsnap.c -o shmsnap
+// Run  : ./shmsnap                          (one read of /dev/shm/droidstat)
+//        ./shmsnap --path /data/local/tmp/droidstat.shm --watch 1
+//        ./shmsnap --stress 5 -j 4          (seqlock torture: writer vs readers, counts torn reads)
+//        ./shmsnap --stress 1 --no-seqlock  (control: same copy without the seq check tears)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../13_droidstat/dsshm.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_snap(const struct dsshm_snap *s, int retries) {
+    double age = (now_ns() - s->mono_ns) / 1e9;
+    printf("sample %llu (age %.3fs, %d retries)\n", (unsigned long long)s->sample, age, retries);
+    if (s->uptime_s >= 0)      printf("uptime_s %.0f\n", s->uptime_s);
+    if (s->mem_total_kb >= 0)  printf("mem_total_kb %lld\n", (long long)s->mem_total_kb);
+    if (s->mem_free_kb >= 0)   printf("mem_free_kb %lld\n", (long long)s->mem_free_kb);
+    if (s->mem_avail_kb >= 0)  printf("mem_avail_kb %lld\n", (long long)s->mem_avail_kb);
+    if (s->mem_cached_kb >= 0) printf("mem_cached_kb %lld\n", (long long)s->mem_cached_kb);
+    if (s->load[0] >= 0)       printf("load1 %.2f\nload5 %.2f\nload15 %.2f\n", s->load[0], s->load[1], s->load[2]);
+    if (s->nr_tasks >= 0)      printf("tasks %d running / %d\n", s->nr_running, s->nr_tasks);
+    int nz = s->nzones < DSSHM_ZONES ? s->nzones : DSSHM_ZONES;
+    for (int i = 0; i < nz; i++)
+        printf("thermal %d %.1f %.*s\n", s->zone[i].id, s->zone[i].milli_c / 1000.0,
+               (int)sizeof(s->zone[i].type), s->zone[i].type);
+}
+
+// ---- stress ----
+// The writer stamps every word of the record with the same counter, so a
+// reader that ever returns a mix of two publishes sees unequal words.
+
+#define WORDS (sizeof(struct dsshm_snap) / 8)
+
+static struct dsshm *st_shm;
+static volatile int st_stop;
+static int st_unsafe;
+
+struct st_reader {
+    pthread_t th;
+    unsigned long reads, retries, torn, stale;
+};
+
+static void *st_writer(void *arg) {
+    unsigned long *writes = arg;
+    static struct dsshm_snap rec;
+    uint64_t *w = (uint64_t *)&rec;
+    for (uint64_t v = 1; !st_stop; v++) {
+        for (size_t i = 0; i < WORDS; i++) w[i] = v;
+        dsshm_publish(st_shm, &rec);
+        (*writes)++;
+    }
+    return NULL;
+}
+
+static void *st_read(void *arg) {
+    struct st_reader *r = arg;
+    struct dsshm_snap s;
+    const uint64_t *w = (const uint64_t *)&s;
+    uint64_t last = 0;
+    while (!st_stop) {
+        int n = 0;
+        if (st_unsafe) {
+            const uint64_t *src = (const uint64_t *)&st_shm->snap;
+            for (size_t i = 0; i < WORDS; i++) ((uint64_t *)&s)[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            if (!w[0]) continue;
+        } else if ((n = dsshm_read(st_shm, &s)) < 0) {
+            continue;
+        }
+        r->reads++;
+        r->retries += (unsigned long)n;
+        for (size_t i = 1; i < WORDS; i++)
+            if (w[i] != w[0]) { r->torn++; break; }
+        if (w[0] < last) r->stale++;    // went backwards: also a seqlock bug
+        last = w[0];
+    }
+    return NULL;
+}
+
+static int run_stress(double seconds, int nreaders) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/shm/shmsnap-stress.%d", (int)getpid());
+    st_shm = dsshm_create(path);
+    if (!st_shm) {
+        // No /dev/shm (Android): fall back to the current directory.
+        snprintf(path, sizeof(path), "shmsnap-stress.%d", (int)getpid());
+        st_shm = dsshm_create(path);
+    }
+    if (!st_shm) { fprintf(stderr, "create %s: %s\n", path, strerror(errno)); return 1; }
+    unlink(path);   // mapping stays valid; nothing left behind
+
+    struct st_reader *rd = calloc((size_t)nreaders, sizeof(*rd));
+    if (!rd) { perror("calloc"); return 1; }
+
+    printf("== seqlock stress: 1 writer, %d readers, %.1fs, %zu-byte record%s ==\n",
+           nreaders, seconds, sizeof(struct dsshm_snap), st_unsafe ? ", NO seqlock" : "");
+
+    unsigned long writes = 0;
+    pthread_t wt;
+    pthread_create(&wt, NULL, st_writer, &writes);
+    for (int i = 0; i < nreaders; i++) pthread_create(&rd[i].th, NULL, st_read, &rd[i]);
+
+    double t0 = now_s();
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    st_stop = 1;
+
+    pthread_join(wt, NULL);
+    unsigned long reads = 0, retries = 0, torn = 0, stale = 0;
+    for (int i = 0; i < nreaders; i++) {
+        pthread_join(rd[i].th, NULL);
+        reads += rd[i].reads;
+        retries += rd[i].retries;
+        torn += rd[i].torn;
+        stale += rd[i].stale;
+    }
+    double dt = now_s() - t0;
+
+    printf("writes : %lu (%.1f M/s)\n", writes, writes / dt / 1e6);
+    printf("reads  : %lu (%.1f M/s), retries %lu (%.2f per read)\n",
+           reads, reads / dt / 1e6, retries, reads ? (double)retries / reads : 0.0);
+    printf("torn   : %lu\n", torn);
+    printf("stale  : %lu\n", stale);
+    if (st_unsafe) puts(torn ? "result : torn reads detected (expected without the seqlock)" : "result : no tears seen; run longer");
+    else puts(torn || stale ? "result : FAIL" : "result : ok");
+
+    free(rd);
+    dsshm_close(st_shm);
+    return !st_unsafe && (torn || stale) ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = DSSHM_DEFAULT_PATH;
+    double watch = 0, stress = 0;
+    int nreaders = 2;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--path") && i + 1 < argc) path = argv[++i];
+        else if (!strcmp(argv[i], "--watch") && i + 1 < argc) watch = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--stress")) {
+            stress = 5;
+            if (i + 1 < argc && atof(argv[i + 1]) > 0) stress = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--no-seqlock")) st_unsafe = 1;
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc) nreaders = atoi(argv[++i]);
+    }
+    if (nreaders <= 0) nreaders = 1;
+    if (nreaders > 64) nreaders = 64;
+
+    if (stress > 0) return run_stress(stress, nreaders);
+
+    errno = 0;
+    struct dsshm *m = dsshm_open(path);
+    if (!m) {
+        fprintf(stderr, "open %s: %s\n", path, errno ? strerror(errno) : "not a droidstat segment");
+        puts("hint: start the publisher: ./droidstat --sample 2 --publish");
+        return 1;
+    }
+
+    int rc = 0;
+    for (;;) {
+        struct dsshm_snap s;
+        int n = dsshm_read(m, &s);
+        if (n == DSSHM_EMPTY) puts("(nothing published yet)");
+        else if (n == DSSHM_BUSY) puts("(writer stuck mid-update: is the publisher still running?)");
+        else print_snap(&s, n);
+        rc = n == DSSHM_BUSY;
+        if (watch <= 0) break;
+
+        puts("----------------------------------------");
+        fflush(stdout);
+        struct timespec ts = { (time_t)watch, (long)((watch - (time_t)watch) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+
+    dsshm_close(m);
+    return rc;
+}
@@ -0,0 +1,270 @@
+// dmatch.h - Kernel log signatures and the multi-pattern matcher
+// Header-only, shared by dmesg_tail --watch and droidstat --dmesg --watch.
+//
+// Pattern file: one "name literal text" per line; '#' starts a comment.
+// No file means the built-in set below. am_build() compiles pats[] into a
+// DFA; am_match_line() runs one record through it. dmesg_tail also steps
+// am.delta directly in interleaved lanes for throughput.
+
+#ifndef DMATCH_H
+#define DMATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// ---- patterns ----
+
+#define PAT_MAX 256
+#define PAT_LEN 128
+
+struct pattern {
+    char name[32];
+    char lit[PAT_LEN];
+    int len;
+    int first;                  // first pattern with this name (names can repeat)
+    unsigned long matched, emitted, suppressed;
+    double win_start;           // dmesg_tail --rate: fixed window per pattern
+    int win_count;
+};
+
+static struct pattern pats[PAT_MAX];
+static int npats;
+
+static const char *default_pats[][2] = {
+    { "oom",          "Out of memory: Killed process" },
+    { "oom_reaper",   "oom_reaper: reaped process" },
+    { "lmk",          "lowmemorykiller: Kill" },
+    { "avc",          "avc:  denied" },
+    { "thermal_crit", "critical temperature reached" },
+    { "thermal_crit", "Critical temperature reached" },
+    { "io_error",     "I/O error" },
+    { "ext4_error",   "EXT4-fs error" },
+    { "f2fs_error",   "F2FS-fs error" },
+    { "soft_lockup",  "watchdog: BUG: soft lockup" },
+    { "hard_lockup",  "Watchdog detected hard LOCKUP" },
+    { "wdog_bark",    "Watchdog bark" },
+    { "hung_task",    "blocked for more than" },
+    { "rcu_stall",    "rcu_preempt detected stall" },
+    { "panic",        "Kernel panic" },
+    { "oops",         "Unable to handle kernel" },
+    { "kernel_bug",   "kernel BUG at" },
+    { "warning",      "WARNING: CPU:" },
+    { "segfault",     "segfault at" },
+};
+
+static inline int add_pattern(const char *name, const char *lit) {
+    int len = (int)strlen(lit);
+    if (len == 0) return 0;
+    if (npats >= PAT_MAX || len >= PAT_LEN) return -1;
+    struct pattern *p = &pats[npats++];
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    memcpy(p->lit, lit, (size_t)len + 1);
+    p->len = len;
+    p->first = npats - 1;
+    for (int i = 0; i < npats - 1; i++)
+        if (!strcmp(pats[i].name, p->name)) { p->first = i; break; }
+    return 0;
+}
+
+// Appends pt's name to the "name,name" list of one record unless a pattern
+// with the same name already put it there; named is a PAT_MAX-bit set.
+static inline void am_add_name(char *names, size_t cap, size_t *nl, uint64_t *named,
+                               const struct pattern *pt) {
+    uint64_t bit = 1ull << (pt->first % 64);
+    if (named[pt->first / 64] & bit) return;
+    named[pt->first / 64] |= bit;
+    int k = snprintf(names + *nl, cap - *nl, "%s%s", *nl ? "," : "", pt->name);
+    if (k > 0 && *nl + (size_t)k < cap) *nl += (size_t)k;
+}
+
+static inline int load_patterns(const char *path) {
+    if (!path) {
+        for (size_t i = 0; i < sizeof(default_pats) / sizeof(default_pats[0]); i++)
+            add_pattern(default_pats[i][0], default_pats[i][1]);
+        return 0;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *p = line + strspn(line, " \t");
+        if (*p == 0 || *p == '#') continue;
+
+        char *name = p;
+        p += strcspn(p, " \t");
+        if (*p) *p++ = 0;
+        p += strspn(p, " \t");
+        if (*p == 0 || add_pattern(name, p) != 0) {
+            fprintf(stderr, "%s:%d: bad or too long pattern (max %d of %d bytes)\n",
+                    path, lineno, PAT_MAX, PAT_LEN - 1);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// ---- matcher ----
+// Aho-Corasick over every literal, flattened into a full DFA with one
+// 256-entry row per state. The trie is built over a compressed alphabet
+// (bytes in no pattern share class 0) and only expanded to bytes at the
+// end. States are stored pre-shifted (row << 8), so a step is one OR and
+// one load with no class lookup or multiply in the dependency chain.
+// Accepting states are numbered last, from a power-of-two row up, so
+// "accepting" is one compare, even on the OR of several scan lanes.
+// '\n' is never in a pattern, so the state falls back to the root at
+// every record boundary.
+
+struct matcher {
+    uint8_t cls[256];
+    uint32_t ncls;
+    uint32_t nstates;
+    uint32_t *delta;            // next = delta[state | byte], states pre-shifted by 8
+    uint32_t acc;               // power of two; states >= acc have outputs
+    uint32_t *out_at;           // per accepting state: range in outs[]
+    uint16_t *outs;
+};
+
+static struct matcher am;
+
+// Builds am from pats[]; may be called again after the set changes.
+static inline int am_build(void) {
+    free(am.delta); free(am.out_at); free(am.outs);
+    am.delta = NULL; am.out_at = NULL; am.outs = NULL;
+    uint32_t ncls = 1;
+    memset(am.cls, 0, sizeof(am.cls));
+    size_t total = 1;
+    for (int i = 0; i < npats; i++) {
+        total += (size_t)pats[i].len;
+        for (int j = 0; j < pats[i].len; j++) {
+            uint8_t c = (uint8_t)pats[i].lit[j];
+            if (!am.cls[c]) am.cls[c] = (uint8_t)ncls++;
+        }
+    }
+    am.ncls = ncls;
+
+    // Trie over classes; -1 = no edge.
+    int32_t *go = malloc(total * ncls * sizeof(int32_t));
+    int32_t *fail = calloc(total, sizeof(int32_t));
+    int32_t *order = malloc(total * sizeof(int32_t));
+    int32_t *own = malloc(total * sizeof(int32_t));     // first own pattern, -1 = none
+    int32_t *next_own = malloc((size_t)(npats ? npats : 1) * sizeof(int32_t));
+    uint32_t *nout = calloc(total, sizeof(uint32_t));
+    if (!go || !fail || !order || !own || !next_own || !nout) return -1;
+    memset(go, 0xff, total * ncls * sizeof(int32_t));
+    memset(own, 0xff, total * sizeof(int32_t));
+
+    uint32_t nstates = 1;
+    for (int i = 0; i < npats; i++) {
+        int32_t s = 0;
+        for (int j = 0; j < pats[i].len; j++) {
+            uint32_t k = am.cls[(uint8_t)pats[i].lit[j]];
+            if (go[(size_t)s * ncls + k] < 0) go[(size_t)s * ncls + k] = (int32_t)nstates++;
+            s = go[(size_t)s * ncls + k];
+        }
+        next_own[i] = own[s];
+        own[s] = i;
+    }
+
+    // BFS: fail links, and turn the trie into a full DFA in place.
+    uint32_t head = 0, tail = 0;
+    order[tail++] = 0;
+    while (head < tail) {
+        int32_t s = order[head++];
+        for (int32_t p = own[s]; p >= 0; p = next_own[p]) nout[s]++;
+        nout[s] += s ? nout[fail[s]] : 0;
+        for (uint32_t k = 0; k < ncls; k++) {
+            int32_t *e = &go[(size_t)s * ncls + k];
+            int32_t f = s ? go[(size_t)fail[s] * ncls + k] : 0;
+            if (*e >= 0) {
+                fail[*e] = s ? f : 0;
+                order[tail++] = *e;
+            } else {
+                *e = f;
+            }
+        }
+    }
+
+    // Renumber: non-accepting states first (root stays 0), accepting states
+    // from a power-of-two row up, so "any lane accepting" is one test on the
+    // OR of the lane states.
+    uint32_t *row = malloc(nstates * sizeof(uint32_t));
+    int32_t *acc_state = malloc(nstates * sizeof(int32_t));
+    if (!row || !acc_state) return -1;
+    uint32_t nrej = 0, nacc = 0, nouts = 0;
+    for (uint32_t i = 0; i < nstates; i++) if (!nout[order[i]]) row[order[i]] = nrej++;
+    am.acc = 1;
+    while (am.acc < nrej) am.acc <<= 1;
+    for (uint32_t i = 0; i < nstates; i++) {
+        int32_t s = order[i];
+        if (!nout[s]) continue;
+        acc_state[nacc] = s;
+        row[s] = am.acc + nacc++;
+        nouts += nout[s];
+    }
+    am.nstates = am.acc + nacc;
+    am.acc <<= 8;
+
+    am.delta = calloc((size_t)am.nstates << 8, sizeof(uint32_t));
+    am.out_at = malloc((nacc + 1) * sizeof(uint32_t));
+    am.outs = malloc((nouts ? nouts : 1) * sizeof(uint16_t));
+    if (!am.delta || !am.out_at || !am.outs) return -1;
+    for (uint32_t s = 0; s < nstates; s++)
+        for (uint32_t b = 0; b < 256; b++)
+            am.delta[row[s] << 8 | b] = row[go[(size_t)s * ncls + am.cls[b]]] << 8;
+
+    // Output lists per accepting state: own patterns, then the fail chain's.
+    uint32_t o = 0;
+    for (uint32_t a = 0; a < nacc; a++) {
+        am.out_at[a] = o;
+        for (int32_t s = acc_state[a]; s; s = fail[s])
+            for (int32_t p = own[s]; p >= 0; p = next_own[p]) am.outs[o++] = (uint16_t)p;
+    }
+    am.out_at[nacc] = o;
+
+    free(go); free(fail); free(order); free(own); free(next_own); free(nout); free(row); free(acc_state);
+    return 0;
+}
+
+// One record through the DFA. Writes "name,name" for every pattern found
+// into names (each name once), bumps their counters and returns how many
+// patterns matched.
+static inline int am_match_line(const char *p, size_t n, char *names, size_t cap) {
+    uint64_t set[PAT_MAX / 64] = { 0 };
+    const uint32_t *D = am.delta, acc = am.acc;
+    uint32_t s = 0;
+    int any = 0;
+    for (size_t i = 0; i < n; i++) {
+        s = D[s | (uint8_t)p[i]];
+        if (__builtin_expect(s >= acc, 0)) {
+            uint32_t a = (s - acc) >> 8;
+            for (uint32_t o = am.out_at[a]; o < am.out_at[a + 1]; o++)
+                set[am.outs[o] / 64] |= 1ull << (am.outs[o] % 64);
+            any = 1;
+        }
+    }
+    if (!any) return 0;
+
+    uint64_t named[PAT_MAX / 64] = { 0 };
+    int found = 0;
+    size_t nl = 0;
+    names[0] = 0;
+    for (int w = 0; w < PAT_MAX / 64; w++) {
+        for (uint64_t bits = set[w]; bits; bits &= bits - 1) {
+            struct pattern *pt = &pats[w * 64 + __builtin_ctzll(bits)];
+            pt->matched++;
+            found++;
+            am_add_name(names, cap, &nl, named, pt);
+        }
+    }
+    return found;
+}
+
+#endif
@@ -0,0 +1,258 @@
+// dsgov.h - Overhead governor for the continuous sampling modes
+// Slows the costliest sources to keep a tool under a CPU and read budget.
+//
+// --budget P caps a tool at P% of one core. Cost is this thread's
+// CLOCK_THREAD_CPUTIME_ID (user + kernel, so generating /proc text counts)
+// plus read volume from /proc/self/io (rchar) against --budget-io. Each
+// source times its own collections (and, with --budget-io, counts the bytes
+// they read); the work a tick does once any source ran (publishing, feeding
+// stats) is charged as tick overhead, which falls as the sources slow down.
+// When a window closes over the CPU budget the source that costs the most
+// CPU per second runs at half rate; over the I/O budget, the one that reads
+// the most. When there is room for a slowed source's cost to double, the
+// last one slowed is restored. Every change is reported so gaps in the data
+// can be explained.
+//
+// A tool whose collections run on worker threads sets
+//   gov.clock = CLOCK_PROCESS_CPUTIME_ID;
+// so their CPU counts too.
+//
+// The including file defines _GNU_SOURCE (SCHED_IDLE, CPU_SET) and
+//   static void gov_note(const char *msg);
+// which prints one governor message wherever that tool's notes go.
+//
+// Use:
+//   int src = gov_add("meminfo");
+//   gov_start(now);
+//   per tick: if (gov_due(src, tick)) { gov_begin(); collect(); gov_end(src); }
+//             if (any ran) { gov_begin(); publish(); gov_end_tick(); }
+//             gov_check(now, tick_hz);
+//             tick += gov_skip(tick + 1);   (then sleep that many extra periods)
+
+#ifndef DSGOV_H
+#define DSGOV_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+static void gov_note(const char *msg);
+
+#define GOV_SRC_MAX 8
+#define GOV_DIV_MAX 64
+#define GOV_WIN_S   5.0
+
+struct gov_src {
+    const char *name;
+    int div;                    // runs every div-th tick
+    double run;                 // thread CPU per collection, smoothed
+    double io;                  // bytes read per collection, smoothed (--budget-io)
+};
+
+static struct {
+    double budget;              // fraction of one core; 0 = off
+    clockid_t clock;            // CPU clock costs are measured on
+    double io_budget;           // read bytes/s; 0 = unchecked
+    int nsrc;
+    struct gov_src src[GOV_SRC_MAX];
+    int slowed[GOV_SRC_MAX * 6];    // stack of halvings, undone last-first
+    int nslowed;
+    double win_wall, win_cpu, t0;
+    unsigned long long win_rchar, r0;
+    double tick_run;            // per-tick overhead when any source ran, smoothed
+    int io_fd;                  // /proc/self/io, kept open for pread
+    unsigned long long self_io; // bytes the governor itself read from it
+    double usage, io_rate;      // last closed window
+} gov = { .clock = CLOCK_THREAD_CPUTIME_ID, .io_fd = -1 };
+
+static inline double gov_cpu_s(void) {
+    struct timespec ts;
+    clock_gettime(gov.clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// rchar without the governor's own reads of /proc/self/io. The value a
+// read returns does not include that read, so earlier reads are subtracted.
+static inline unsigned long long gov_rchar(void) {
+    char buf[512];
+    if (gov.io_fd < 0) gov.io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (gov.io_fd < 0) return 0;
+    ssize_t n = pread(gov.io_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return 0;
+    buf[n] = 0;
+    unsigned long long own = gov.self_io;
+    gov.self_io += (unsigned long long)n;
+    char *p = strstr(buf, "rchar:");
+    return p ? strtoull(p + 6, NULL, 10) - own : 0;
+}
+
+static inline int gov_add(const char *name) {
+    if (gov.nsrc == GOV_SRC_MAX) return GOV_SRC_MAX - 1;
+    gov.src[gov.nsrc].name = name;
+    gov.src[gov.nsrc].div = 1;
+    return gov.nsrc++;
+}
+
+static inline int gov_due(int i, unsigned long tick) { return tick % (unsigned long)gov.src[i].div == 0; }
+static inline double gov_smooth(double avg, double v) { return avg > 0 ? 0.7 * avg + 0.3 * v : v; }
+
+static inline void gov_begin(void) {
+    if (gov.budget <= 0) return;
+    if (gov.io_budget > 0) gov.r0 = gov_rchar();
+    gov.t0 = gov_cpu_s();
+}
+
+static inline void gov_end(int i) {
+    if (gov.budget <= 0) return;
+    struct gov_src *s = &gov.src[i];
+    s->run = gov_smooth(s->run, gov_cpu_s() - gov.t0);
+    if (gov.io_budget > 0) s->io = gov_smooth(s->io, (double)(gov_rchar() - gov.r0));
+}
+
+static inline void gov_end_tick(void) {
+    if (gov.budget > 0) gov.tick_run = gov_smooth(gov.tick_run, gov_cpu_s() - gov.t0);
+}
+
+// Ticks with any source due: the tick overhead runs at base_hz / this.
+static inline int gov_min_div(void) {
+    int d = GOV_DIV_MAX;
+    for (int i = 0; i < gov.nsrc; i++) if (gov.src[i].div < d) d = gov.src[i].div;
+    return d;
+}
+
+// Ticks after this one that no source is due on; a loop sleeps through them
+// instead of waking to do nothing, so the wakeups slow down with the sources.
+static inline unsigned long gov_skip(unsigned long tick) {
+    if (!gov.nsrc) return 0;
+    unsigned long k = GOV_DIV_MAX;
+    for (int i = 0; i < gov.nsrc; i++) {
+        unsigned long d = (unsigned long)gov.src[i].div, wait = (d - tick % d) % d;
+        if (wait < k) k = wait;
+    }
+    return k;
+}
+
+static inline void gov_start(double now) {
+    gov.win_wall = now;
+    gov.win_cpu = gov_cpu_s();
+    gov.win_rchar = gov_rchar();
+}
+
+// Optional: never compete with real work, and stay off the other cores.
+static inline void gov_sched(int idle, int cpu) {
+    char msg[128];
+    if (idle) {
+        struct sched_param sp = { 0 };
+        if (sched_setscheduler(0, SCHED_IDLE, &sp) == 0) snprintf(msg, sizeof(msg), "governor: running under SCHED_IDLE");
+        else snprintf(msg, sizeof(msg), "governor: SCHED_IDLE failed: %s", strerror(errno));
+        gov_note(msg);
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == 0) snprintf(msg, sizeof(msg), "governor: pinned to cpu %d", cpu);
+        else snprintf(msg, sizeof(msg), "governor: pinning to cpu %d failed: %s", cpu, strerror(errno));
+        gov_note(msg);
+    }
+}
+
+// Halves the costliest source (by CPU, or by bytes read when io) until the
+// projection fits, so a big overshoot settles in one window rather than one
+// step per window. What the sources and tick overhead do not explain stays
+// in the projection as a fixed cost. Returns whether anything changed.
+static inline int gov_shed(int io, double base_hz) {
+    double cost[GOV_SRC_MAX], limit = io ? gov.io_budget : gov.budget;
+    double tick = io ? 0 : gov.tick_run * base_hz;
+    double fixed = (io ? gov.io_rate : gov.usage) - tick / gov_min_div();
+    for (int i = 0; i < gov.nsrc; i++) {
+        cost[i] = (io ? gov.src[i].io : gov.src[i].run) * base_hz / gov.src[i].div;
+        fixed -= cost[i];
+    }
+    if (fixed < 0) fixed = 0;
+
+    char msg[192];
+    int changed = 0;
+    for (;;) {
+        double proj = fixed + tick / gov_min_div();
+        for (int i = 0; i < gov.nsrc; i++) proj += cost[i];
+        if (proj <= limit) break;
+
+        int worst = -1;
+        for (int i = 0; i < gov.nsrc; i++)
+            if (gov.src[i].div < GOV_DIV_MAX && (worst < 0 || cost[i] > cost[worst])) worst = i;
+        if (worst < 0 || gov.nslowed == (int)(sizeof(gov.slowed) / sizeof(gov.slowed[0]))) break;
+
+        struct gov_src *s = &gov.src[worst];
+        if (io) snprintf(msg, sizeof(msg), "governor: io %.0f KB/s over budget: %s %.2f -> %.2f Hz",
+                         gov.io_rate / 1024, s->name, base_hz / s->div, base_hz / (s->div * 2));
+        else snprintf(msg, sizeof(msg), "governor: cpu %.2f%% over budget: %s %.2f -> %.2f Hz",
+                      gov.usage * 100, s->name, base_hz / s->div, base_hz / (s->div * 2));
+        gov_note(msg);
+        s->div *= 2;
+        gov.slowed[gov.nslowed++] = worst;
+        cost[worst] /= 2;
+        changed = 1;
+    }
+    return changed;
+}
+
+// Call once per tick; closes the window every GOV_WIN_S. base_hz is the
+// full tick rate. Costs are per-collection costs times the current rate, so
+// a slow source that happened not to run in this window still counts.
+static inline void gov_check(double now, double base_hz) {
+    if (gov.budget <= 0 || now - gov.win_wall < GOV_WIN_S) return;
+
+    double wall = now - gov.win_wall;
+    unsigned long long rchar = gov_rchar();
+    gov.usage = (gov_cpu_s() - gov.win_cpu) / wall;
+    gov.io_rate = (rchar - gov.win_rchar) / wall;
+    int cpu_over = gov.usage > gov.budget;
+    int io_over = gov.io_budget > 0 && gov.io_rate > gov.io_budget;
+    char msg[192];
+
+    if (cpu_over || io_over) {
+        int changed = 0;
+        if (cpu_over) changed |= gov_shed(0, base_hz);
+        if (io_over) changed |= gov_shed(1, base_hz);
+        if (!changed) {
+            snprintf(msg, sizeof(msg), "governor: cpu %.2f%% io %.0f KB/s over budget with every source at its floor",
+                     gov.usage * 100, gov.io_rate / 1024);
+            gov_note(msg);
+        }
+    } else if (gov.nslowed) {
+        // Restoring doubles that source's cost (and at most the tick
+        // overhead); only do it if that still fits both budgets.
+        struct gov_src *s = &gov.src[gov.slowed[gov.nslowed - 1]];
+        double add = (s->run + gov.tick_run) * base_hz / s->div;
+        double add_io = s->io * base_hz / s->div;
+        if (gov.usage + add < gov.budget * 0.8 &&
+            (gov.io_budget <= 0 || gov.io_rate + add_io < gov.io_budget * 0.8)) {
+            snprintf(msg, sizeof(msg), "governor: cpu %.2f%% under budget: %s %.2f -> %.2f Hz",
+                     gov.usage * 100, s->name, base_hz / s->div, base_hz / (s->div / 2));
+            gov_note(msg);
+            s->div /= 2;
+            gov.nslowed--;
+        }
+    }
+    gov_start(now);
+}
+
+static inline void gov_summary(double base_hz) {
+    if (gov.budget <= 0) return;
+    char msg[512];
+    int n = snprintf(msg, sizeof(msg), "governor: cpu %.2f%% of %.2f%% budget", gov.usage * 100, gov.budget * 100);
+    if (gov.io_budget > 0 && n < (int)sizeof(msg))
+        n += snprintf(msg + n, sizeof(msg) - (size_t)n, ", io %.0f of %.0f KB/s", gov.io_rate / 1024, gov.io_budget / 1024);
+    for (int i = 0; i < gov.nsrc && n < (int)sizeof(msg); i++)
+        if (gov.src[i].div > 1)
+            n += snprintf(msg + n, sizeof(msg) - (size_t)n, ", %s at %.2f Hz", gov.src[i].name, base_hz / gov.src[i].div);
+    gov_note(msg);
+}
+
+#endif
@@ -0,0 +1,136 @@
+// kvfile.h - /proc/vmstat and /proc/meminfo read by slot, for meminfo and droidstat
+// Maps each line to a tracked counter once, then samples with one pread.
+//
+// Both files stay open and are re-read with pread(). Line order is fixed for
+// the life of the kernel, so names are matched to slots once; a sample then
+// walks lines by index, parsing only the tracked ones and summing them into
+// their slot. A slot no line fed is -1 (MemAvailable before 3.14, a counter
+// a kernel does not have), never 0. A change in line count means the layout
+// moved and the caller re-resolves.
+//
+//   struct kvfile f;
+//   kv_open(&f, "/proc/vmstat", vm_slot);
+//   int64_t v[VM_N];
+//   if (kv_sample(&f, v, VM_N) > 0) { kv_close(&f); kv_open(...); }
+
+#ifndef KVFILE_H
+#define KVFILE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define KV_LINES 512
+
+struct kvfile {
+    const char *path;           // NULL = never opened
+    int fd, nlines;
+    int8_t slot[KV_LINES];      // line -> slot, -1 = untracked
+    char buf[32768];
+};
+
+static inline int kv_read(struct kvfile *f) {
+    ssize_t n = pread(f->fd, f->buf, sizeof(f->buf) - 1, 0);
+    if (n <= 0) return -1;
+    f->buf[n] = 0;
+    return 0;
+}
+
+static inline void kv_close(struct kvfile *f) {
+    if (f->path && f->fd >= 0) close(f->fd);
+    f->fd = -1;
+}
+
+static inline int kv_open(struct kvfile *f, const char *path, int (*slot_of)(const char *name, size_t n)) {
+    f->path = path;
+    f->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (f->fd < 0) return -1;
+    if (kv_read(f) != 0) { kv_close(f); return -1; }
+
+    f->nlines = 0;
+    for (char *p = f->buf; *p && f->nlines < KV_LINES; f->nlines++) {
+        size_t n = strcspn(p, " :\n");
+        f->slot[f->nlines] = (int8_t)slot_of(p, n);
+        char *e = strchr(p, '\n');
+        if (!e) { f->nlines++; break; }
+        p = e + 1;
+    }
+    return 0;
+}
+
+// 0 = val[] filled, 1 = layout changed (re-open), -1 = read failed.
+static inline int kv_sample(struct kvfile *f, int64_t *val, int nslots) {
+    if (kv_read(f) != 0) return -1;
+    for (int i = 0; i < nslots; i++) val[i] = -1;
+
+    int line = 0;
+    for (const char *p = f->buf; *p; line++) {
+        const char *e = strchr(p, '\n');
+        if (line < f->nlines && f->slot[line] >= 0) {
+            const char *q = p;
+            while (*q && *q != ' ' && *q != ':') q++;
+            while (*q == ' ' || *q == ':') q++;
+            int64_t v = 0;
+            while (*q >= '0' && *q <= '9') v = v * 10 + (*q++ - '0');
+            int64_t *s = &val[f->slot[line]];
+            *s = (*s < 0 ? 0 : *s) + v;
+        }
+        if (!e) { line++; break; }
+        p = e + 1;
+    }
+    return line == f->nlines ? 0 : 1;
+}
+
+// ---- tracked counters ----
+// Each vmstat slot sums the listed names; names differ across kernels
+// (workingset_refault split into _anon/_file in 5.9, allocstall per zone).
+// col is meminfo's column header, name droidstat's metric; hi is the
+// rolling-stats histogram range, rarer spikes land in the stretched top bin.
+
+enum {
+    VM_SCAN_K, VM_SCAN_D, VM_STEAL_K, VM_STEAL_D, VM_MAJFLT, VM_REFAULT,
+    VM_ALLOCST, VM_COMPACT, VM_SWPIN, VM_SWPOUT, VM_OOMKILL, VM_N
+};
+
+static const struct { const char *col, *name, *names; double hi; } vm_defs[VM_N] = {
+    [VM_SCAN_K]  = { "scan_k",  "pgscan_kswapd/s",  "pgscan_kswapd", 200000 },
+    [VM_SCAN_D]  = { "scan_d",  "pgscan_direct/s",  "pgscan_direct", 50000 },
+    [VM_STEAL_K] = { "steal_k", "pgsteal_kswapd/s", "pgsteal_kswapd", 200000 },
+    [VM_STEAL_D] = { "steal_d", "pgsteal_direct/s", "pgsteal_direct", 50000 },
+    [VM_MAJFLT]  = { "majflt",  "pgmajfault/s",     "pgmajfault", 5000 },
+    [VM_REFAULT] = { "refault", "refault/s",
+                     "workingset_refault workingset_refault_anon workingset_refault_file", 50000 },
+    [VM_ALLOCST] = { "allocst", "allocstall/s",
+                     "allocstall allocstall_dma allocstall_dma32 allocstall_normal allocstall_movable allocstall_device", 1000 },
+    [VM_COMPACT] = { "compact", "compact_stall/s",  "compact_stall", 1000 },
+    [VM_SWPIN]   = { "swpin",   "pswpin/s",         "pswpin", 50000 },
+    [VM_SWPOUT]  = { "swpout",  "pswpout/s",        "pswpout", 50000 },
+    [VM_OOMKILL] = { "oomkill", "oom_kill/s",       "oom_kill", 10 },
+};
+
+enum { MI_TOTAL, MI_FREE, MI_AVAIL, MI_CACHED, MI_SWAPFREE, MI_N };
+
+static const char *mi_keys[MI_N] = { "MemTotal", "MemFree", "MemAvailable", "Cached", "SwapFree" };
+
+static inline int kv_in_list(const char *list, const char *name, size_t n) {
+    for (const char *p = list; *p; ) {
+        size_t k = strcspn(p, " ");
+        if (k == n && !memcmp(p, name, n)) return 1;
+        p += k;
+        while (*p == ' ') p++;
+    }
+    return 0;
+}
+
+static inline int vm_slot(const char *name, size_t n) {
+    for (int i = 0; i < VM_N; i++) if (kv_in_list(vm_defs[i].names, name, n)) return i;
+    return -1;
+}
+
+static inline int mi_slot(const char *name, size_t n) {
+    for (int i = 0; i < MI_N; i++) if (strlen(mi_keys[i]) == n && !memcmp(mi_keys[i], name, n)) return i;
+    return -1;
+}
+
+#endif
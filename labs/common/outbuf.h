@@ -0,0 +1,174 @@
+// outbuf.h - Buffered table output shared by mounts, threads and netpeek
+// Static 64 KB buffer and column table; one write() per flush, no allocation.
+//
+// Rows are formatted by hand into one 64 KB buffer and flushed with write(),
+// instead of a printf per row. --format picks aligned text (default), csv,
+// tsv or json (one object per row).
+//
+//   static const struct col cols[] = { { "PID", 6, 0 }, { "NAME", 0, 0 } };
+//   out.fmt = parse_format("csv");
+//   out_table(cols, 2);
+//   out_int(1); out_str("init"); out_end_row();
+//   out_flush();
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+enum { FMT_TEXT, FMT_CSV, FMT_TSV, FMT_JSON };
+
+struct col {
+    const char *name;
+    int width;          // text width; 0 = unpadded last column, -1 = machine formats only
+    int trunc;          // text: cut values longer than width (like %-18.18s)
+};
+
+static struct {
+    char buf[1 << 16];
+    size_t len;
+    int fmt;
+    const struct col *cols;
+    int ncols, col, emitted, header_done;
+} out;
+
+static inline int parse_format(const char *s) {
+    if (!strcmp(s, "text")) return FMT_TEXT;
+    if (!strcmp(s, "csv"))  return FMT_CSV;
+    if (!strcmp(s, "tsv"))  return FMT_TSV;
+    if (!strcmp(s, "json")) return FMT_JSON;
+    return -1;
+}
+
+static inline void out_write(const char *s, size_t n) {
+    while (n) {
+        ssize_t k = write(STDOUT_FILENO, s, n);
+        if (k < 0) { if (errno == EINTR) continue; return; }
+        s += k;
+        n -= (size_t)k;
+    }
+}
+
+static inline void out_flush(void) {
+    fflush(stdout);     // keep ordering with anything printed through stdio
+    out_write(out.buf, out.len);
+    out.len = 0;
+}
+
+static inline void out_raw(const char *s, size_t n) {
+    if (out.len + n > sizeof(out.buf)) {
+        out_flush();
+        if (n > sizeof(out.buf)) { out_write(s, n); return; }
+    }
+    memcpy(out.buf + out.len, s, n);
+    out.len += n;
+}
+
+static inline void out_ch(char c) {
+    if (out.len == sizeof(out.buf)) out_flush();
+    out.buf[out.len++] = c;
+}
+
+static inline void out_pad(int n) {
+    while (n-- > 0) out_ch(' ');
+}
+
+// Free-form lines (titles, notes) only belong in the text format.
+static inline void out_note(const char *s) {
+    if (out.fmt != FMT_TEXT) return;
+    out_raw(s, strlen(s));
+    out_ch('\n');
+}
+
+static inline void out_cell(const char *s, size_t n, int is_num) {
+    const struct col *c = &out.cols[out.col++];
+
+    switch (out.fmt) {
+    case FMT_TEXT:
+        if (c->width < 0) return;
+        if (out.emitted++) out_ch(' ');
+        if (c->trunc && n > (size_t)c->width) n = (size_t)c->width;
+        out_raw(s, n);
+        if (c->width > 0) out_pad(c->width - (int)n);
+        return;
+    case FMT_CSV:
+        if (out.emitted++) out_ch(',');
+        if (!is_num && (memchr(s, ',', n) || memchr(s, '"', n) || memchr(s, '\n', n))) {
+            out_ch('"');
+            for (size_t i = 0; i < n; i++) {
+                if (s[i] == '"') out_ch('"');
+                out_ch(s[i]);
+            }
+            out_ch('"');
+            return;
+        }
+        out_raw(s, n);
+        return;
+    case FMT_TSV:
+        if (out.emitted++) out_ch('\t');
+        for (size_t i = 0; i < n; i++) out_ch(s[i] == '\t' || s[i] == '\n' ? ' ' : s[i]);
+        return;
+    case FMT_JSON:
+        out_ch(out.emitted++ ? ',' : '{');
+        out_ch('"');
+        out_raw(c->name, strlen(c->name));
+        out_raw("\":", 2);
+        if (is_num) { out_raw(s, n); return; }
+        out_ch('"');
+        for (size_t i = 0; i < n; i++) {
+            unsigned char ch = (unsigned char)s[i];
+            if (ch == '"' || ch == '\\') { out_ch('\\'); out_ch((char)ch); }
+            else if (ch < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                char e[6] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 15] };
+                out_raw(e, 6);
+            } else out_ch((char)ch);
+        }
+        out_ch('"');
+        return;
+    }
+}
+
+static inline void out_end_row(void) {
+    if (out.fmt == FMT_JSON) out_ch('}');
+    out_ch('\n');
+    out.col = 0;
+    out.emitted = 0;
+}
+
+// Text prints the header for every table; csv/tsv print it once; json never.
+static inline void out_table(const struct col *cols, int ncols) {
+    out.cols = cols;
+    out.ncols = ncols;
+    out.col = out.emitted = 0;
+    if (out.fmt == FMT_JSON || (out.fmt != FMT_TEXT && out.header_done)) return;
+    out.header_done = 1;
+    for (int i = 0; i < ncols; i++) out_cell(cols[i].name, strlen(cols[i].name), 0);
+    out_end_row();
+}
+
+static inline void out_str(const char *s) { out_cell(s, strlen(s), 0); }
+
+// Writes the decimal digits of v ending at `end`; returns the first char.
+static inline char *fmt_u64(char *end, unsigned long long v) {
+    do { *--end = (char)('0' + v % 10); v /= 10; } while (v);
+    return end;
+}
+
+static inline void out_int(long long v) {
+    char tmp[24], *end = tmp + sizeof(tmp);
+    char *p = fmt_u64(end, v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v);
+    if (v < 0) *--p = '-';
+    out_cell(p, (size_t)(end - p), 1);
+}
+
+static inline void out_num(double v, int prec) {
+    char b[32];
+    int n = snprintf(b, sizeof(b), "%.*f", prec, v);
+    out_cell(b, n > 0 ? (size_t)n : 0, 1);
+}
+
+#endif
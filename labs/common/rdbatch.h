@@ -0,0 +1,234 @@
+// rdbatch.h - Batched small-file reader shared by thermal, threads and droidstat
+// Reads each path into the caller's buffer; nothing is allocated per sweep.
+//
+// A sweep is a list of tiny files (sysfs/procfs). The sync backend does
+// open/read/close per file; the io_uring backend submits linked
+// OPENAT -> READ -> CLOSE chains for the whole sweep in one syscall.
+// Each result is NUL-terminated with one trailing '\n' removed.
+//
+// Set g_use_uring = 1 to try io_uring (5.17+); read_batch() falls back to
+// sync reads when it is unavailable or fails mid-sweep (the ring is then
+// torn down for good). g_syscalls counts syscalls issued; rd_path_name()
+// says which backend the sweeps since g_rd_path = 0 actually used.
+// A tool that accounts its own I/O defines, before including this file,
+//   #define RD_ACCOUNT(ok, bytes) my_counter(ok, bytes)
+// which runs once per file read.
+
+#ifndef RDBATCH_H
+#define RDBATCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#ifndef RD_ACCOUNT
+#define RD_ACCOUNT(ok, bytes) ((void)0)
+#endif
+
+struct rd {
+    const char *path;
+    char *buf;
+    size_t cap;
+    int res;            // bytes read, or -errno
+};
+
+enum { RD_PATH_SYNC = 1, RD_PATH_URING = 2 };
+
+static int g_use_uring = 0;
+static unsigned long g_syscalls = 0;
+static int g_rd_path = 0;       // RD_PATH_* bits of the backends that ran
+
+static inline const char *rd_path_name(void) {
+    switch (g_rd_path) {
+        case RD_PATH_SYNC:  return "sync";
+        case RD_PATH_URING: return "io_uring";
+        case RD_PATH_SYNC | RD_PATH_URING: return "mixed";
+        default: return "-";
+    }
+}
+
+static inline void rd_finish(struct rd *r) {
+    RD_ACCOUNT(r->res >= 0, r->res >= 0 ? (unsigned long)r->res : 0);
+    if (r->res >= 0) {
+        r->buf[r->res] = '\0';
+        if (r->res && r->buf[r->res - 1] == '\n') r->buf[r->res - 1] = '\0';
+    } else {
+        r->buf[0] = '\0';
+    }
+}
+
+static inline void read_batch_sync(struct rd *v, int n) {
+    for (int i = 0; i < n; i++) {
+        struct rd *r = &v[i];
+        g_syscalls++;
+        int fd = open(r->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { r->res = -errno; rd_finish(r); continue; }
+        ssize_t k = read(fd, r->buf, r->cap - 1);
+        r->res = (k < 0) ? -errno : (int)k;
+        close(fd);
+        g_syscalls += 2;
+        rd_finish(r);
+    }
+}
+
+#define URING_ENTRIES 256
+#define URING_FILES   64    // files per submission (3 SQEs each)
+
+struct uring {
+    int fd;             // -1 = not tried yet, -2 = unavailable
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *ring;
+    size_t ring_sz, sqes_sz;
+};
+
+static struct uring g_ring = { .fd = -1 };
+
+static inline int uring_init(void) {
+    if (g_ring.fd >= 0) return 0;
+    if (g_ring.fd == -2) return -1;
+    g_ring.fd = -2;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) return -1;
+
+    // Linked OPENAT -> READ on a direct descriptor needs 5.17+ (LINKED_FILE).
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_LINKED_FILE)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    size_t sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    char *ring = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) { close(fd); return -1; }
+    void *sqes = mmap(NULL, sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) { munmap(ring, ring_sz); close(fd); return -1; }
+
+    // Sparse direct-descriptor table: one slot per in-flight file.
+    int files[URING_FILES];
+    for (int i = 0; i < URING_FILES; i++) files[i] = -1;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, files, URING_FILES) < 0) {
+        munmap(sqes, sqes_sz); munmap(ring, ring_sz); close(fd);
+        return -1;
+    }
+
+    g_ring.sq_tail  = (unsigned *)(ring + p.sq_off.tail);
+    g_ring.sq_mask  = (unsigned *)(ring + p.sq_off.ring_mask);
+    g_ring.sq_array = (unsigned *)(ring + p.sq_off.array);
+    g_ring.cq_head  = (unsigned *)(ring + p.cq_off.head);
+    g_ring.cq_tail  = (unsigned *)(ring + p.cq_off.tail);
+    g_ring.cq_mask  = (unsigned *)(ring + p.cq_off.ring_mask);
+    g_ring.cqes     = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    g_ring.sqes     = sqes;
+    g_ring.ring     = ring;
+    g_ring.ring_sz  = ring_sz;
+    g_ring.sqes_sz  = sqes_sz;
+    g_ring.fd = fd;
+    return 0;
+}
+
+// After a failed io_uring_enter the ring may hold submitted SQEs and
+// unreaped CQEs, so it is never reused. Unregistering the file table
+// closes any direct descriptors the aborted chains left installed.
+static inline void uring_teardown(void) {
+    if (g_ring.fd < 0) return;
+    syscall(__NR_io_uring_register, g_ring.fd, IORING_UNREGISTER_FILES, NULL, 0);
+    munmap(g_ring.sqes, g_ring.sqes_sz);
+    munmap(g_ring.ring, g_ring.ring_sz);
+    close(g_ring.fd);
+    g_ring.fd = -2;
+}
+
+static inline struct io_uring_sqe *uring_sqe(unsigned *tail) {
+    unsigned idx = *tail & *g_ring.sq_mask;
+    struct io_uring_sqe *e = &g_ring.sqes[idx];
+    memset(e, 0, sizeof(*e));
+    g_ring.sq_array[idx] = idx;
+    (*tail)++;
+    return e;
+}
+
+static inline int read_batch_uring(struct rd *v, int n) {
+    for (int base = 0; base < n; base += URING_FILES) {
+        int m = (n - base < URING_FILES) ? n - base : URING_FILES;
+        unsigned tail = *g_ring.sq_tail;
+
+        for (int s = 0; s < m; s++) {
+            struct rd *r = &v[base + s];
+            uint64_t id = (uint64_t)(base + s) << 2;
+            r->res = 1;     // pending
+
+            struct io_uring_sqe *e = uring_sqe(&tail);
+            e->opcode = IORING_OP_OPENAT;
+            e->fd = AT_FDCWD;
+            e->addr = (uintptr_t)r->path;
+            e->open_flags = O_RDONLY;   // O_CLOEXEC is invalid for direct descriptors
+            e->file_index = (unsigned)s + 1;
+            e->flags = IOSQE_IO_LINK;
+            e->user_data = id | 0;
+
+            e = uring_sqe(&tail);
+            e->opcode = IORING_OP_READ;
+            e->fd = s;
+            e->addr = (uintptr_t)r->buf;
+            e->len = (unsigned)(r->cap - 1);
+            e->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            e->user_data = id | 1;
+
+            e = uring_sqe(&tail);
+            e->opcode = IORING_OP_CLOSE;
+            e->file_index = (unsigned)s + 1;
+            e->user_data = id | 2;
+        }
+        __atomic_store_n(g_ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned want = (unsigned)m * 3, got = 0, submit = want;
+        while (got < want) {
+            g_syscalls++;
+            int rc = (int)syscall(__NR_io_uring_enter, g_ring.fd, submit, want - got,
+                                  IORING_ENTER_GETEVENTS, NULL, 0);
+            if (rc < 0 && errno != EINTR) return -1;
+            if (rc > 0) submit -= (unsigned)rc < submit ? (unsigned)rc : submit;
+
+            unsigned head = *g_ring.cq_head;
+            unsigned ctail = __atomic_load_n(g_ring.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != ctail; head++, got++) {
+                struct io_uring_cqe *c = &g_ring.cqes[head & *g_ring.cq_mask];
+                struct rd *r = &v[c->user_data >> 2];
+                unsigned op = (unsigned)(c->user_data & 3);
+                if (op == 0 && c->res < 0) r->res = c->res;
+                else if (op == 1 && r->res == 1) r->res = c->res;
+            }
+            __atomic_store_n(g_ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    for (int i = 0; i < n; i++) rd_finish(&v[i]);
+    return 0;
+}
+
+static inline void read_batch(struct rd *v, int n) {
+    if (g_use_uring && uring_init() == 0) {
+        if (read_batch_uring(v, n) == 0) { g_rd_path |= RD_PATH_URING; return; }
+        uring_teardown();
+    }
+    read_batch_sync(v, n);
+    g_rd_path |= RD_PATH_SYNC;
+}
+
+
+#endif